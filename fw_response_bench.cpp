@@ -0,0 +1,136 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+/*
+ * Times parsing firmware responses the way get_time_now() and get_rx_gain() do, with
+ * chameleon_fw_comms::setResponse() against the std::regex tokenizer it replaced, and
+ * writing a freq_set command against the std::stringstream it used to be built with.
+ * Needs no radio. Build with CMAKE_BUILD_TYPE=Release, debug builds print every response.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include "safe_main.hpp"
+#include "chameleon_fw_common.hpp"
+
+namespace po = boost::program_options;
+
+/* The parser setResponse() used to have, kept here as the baseline */
+static std::vector<std::string> regex_tokenize(const std::string &str, const std::regex &re) {
+    std::sregex_token_iterator it{str.begin(), str.end(), re, -1};
+    std::vector<std::string> tokenized{it, {}};
+    tokenized.erase(std::remove_if(tokenized.begin(), tokenized.end(),
+                                   [](std::string const &s) { return s.empty(); }), tokenized.end());
+    return tokenized;
+}
+
+static double regex_parse(const char *response, const uint32_t sequence, const char *command) {
+    const std::regex comma_regx(R"([,]+)");
+    const std::regex space_regx(R"([\s]+)");
+    const std::vector<std::string> tokenized = regex_tokenize(std::string(response), comma_regx);
+    const std::vector<std::string> response_copy = tokenized; /* getResponse() returned a copy */
+    if (tokenized.size() < 3 || tokenized[0] != "ACK") {
+        return -1;
+    }
+    const std::vector<std::string> cmd_tokenized = regex_tokenize(tokenized[1], space_regx);
+    if (cmd_tokenized.size() != 2 || std::stoul(cmd_tokenized[0]) != sequence || cmd_tokenized[1] != command) {
+        return -1;
+    }
+    const std::string x = response_copy.at(2);
+    return std::stod(x.substr(x.find('=') + 1));
+}
+
+/* How freq_set and the sequence number used to be written */
+static double stringstream_format(const uint32_t sequence, const size_t chan, const uint64_t freq,
+                                  const uint32_t cal_mask) {
+    std::stringstream cmd;
+    cmd << "freq_set" << " chan=" << chan << "," " freq=" << freq << ", calmask=" << std::hex << cal_mask;
+    std::stringstream ss;
+    ss << sequence << " " << cmd.str();
+    return static_cast<double>(ss.str().length());
+}
+
+static double format(const uint32_t sequence, const size_t chan, const uint64_t freq, const uint32_t cal_mask) {
+    ihd::chameleon_fw_comms request(sequence, ihd::chameleon_fw_cmd_tune(chan, freq, cal_mask));
+    return static_cast<double>(request.getCommandSize());
+}
+
+static double parse(ihd::chameleon_fw_comms &request, const char *response) {
+    double value = -1;
+    request.setResponse(response);
+    if (request.getResult() != ihd::chameleon_fw_comms::ACK || !request.getValue(0, value)) {
+        return -1;
+    }
+    return value;
+}
+
+static volatile double sink; /* Keeps the timed calls from being optimized away */
+
+template<typename F>
+static double time_ns(const size_t iterations, F f) {
+    double sum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        sum += f();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    sink = sum;
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) /
+           static_cast<double>(iterations);
+}
+
+int IHD_SAFE_MAIN(int argc, char *argv[]) {
+    size_t iterations;
+
+    po::options_description desc("Allowed options");
+    desc.add_options()
+            ("help", "help message")
+            ("iterations", po::value<size_t>(&iterations)->default_value(200000), "responses to parse per case");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    if (vm.count("help") || iterations == 0) {
+        std::cout << boost::format("Firmware response parser benchmark %s") % desc << std::endl;
+        return ~0;
+    }
+
+    constexpr uint32_t sequence = 1234;
+    ihd::chameleon_fw_comms time_request(sequence, ihd::chameleon_fw_get_time());
+    ihd::chameleon_fw_comms gain_request(sequence, ihd::chameleon_fw_cmd_get_rxgain(0));
+    const char *time_response = "ACK,1234 get_time,time=1718901234.000125";
+    const char *gain_response = "ACK,1234 get_rxgain,gain=12.5";
+
+    if (parse(time_request, time_response) != regex_parse(time_response, sequence, "get_time") ||
+        parse(gain_request, gain_response) != regex_parse(gain_response, sequence, "get_rxgain") ||
+        format(sequence, 1, 2400000000, 0x3200) != stringstream_format(sequence, 1, 2400000000, 0x3200)) {
+        std::cerr << "The parsers disagree" << std::endl;
+        return ~0;
+    }
+
+    const double regex_time = time_ns(iterations, [&] { return regex_parse(time_response, sequence, "get_time"); });
+    const double time = time_ns(iterations, [&] { return parse(time_request, time_response); });
+    const double regex_gain = time_ns(iterations, [&] { return regex_parse(gain_response, sequence, "get_rxgain"); });
+    const double gain = time_ns(iterations, [&] { return parse(gain_request, gain_response); });
+    const double stringstream_tune = time_ns(iterations, [&] {
+        return stringstream_format(sequence, 1, 2400000000, 0x3200);
+    });
+    const double tune = time_ns(iterations, [&] { return format(sequence, 1, 2400000000, 0x3200); });
+
+    std::cout << boost::format("%-12s %12s %12s %8s") % "case" % "old ns" % "ns" % "speedup" << std::endl;
+    std::cout << boost::format("%-12s %12.1f %12.1f %7.1fx") % "get_time" % regex_time % time % (regex_time / time)
+              << std::endl;
+    std::cout << boost::format("%-12s %12.1f %12.1f %7.1fx") % "get_rxgain" % regex_gain % gain % (regex_gain / gain)
+              << std::endl;
+    std::cout << boost::format("%-12s %12.1f %12.1f %7.1fx") % "freq_set" % stringstream_tune % tune
+                 % (stringstream_tune / tune) << std::endl;
+    return 0;
+}
@@ -21,4 +21,6 @@
 
 #define THROW_MALLOC_ERROR() throw std::runtime_error("Memory Allocation error")
 
+#define THROW_NARROWING_ERROR() throw std::range_error("Narrowing conversion error")
+
 #endif //EXCEPTION_HPP
@@ -53,6 +53,19 @@ public:
      virtual int get_temperatures(temperature_t &temperatures, size_t timeout) = 0;
      virtual int stream_stop_all() = 0;
 
+     /*! Frequency (Hz) and gain (dB) of one rx channel for set_rx_configs() */
+     struct rx_config_t {
+         size_t chan;
+         double freq;
+         double gain;
+     };
+     /*!
+      * Tune and set the gain of several rx channels with all the commands in flight at once,
+      * in about one round trip instead of two per channel
+      * \return 0 if every command was ACKed, -1 otherwise
+      */
+     virtual int set_rx_configs(const std::vector<rx_config_t> &configs, size_t timeout) = 0;
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
     uhd::device::sptr      get_device() override { THROW_NOT_IMPLEMENTED_ERROR(); }
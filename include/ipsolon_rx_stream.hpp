@@ -8,8 +8,15 @@
 #define IPSOLON_STREAM_HPP
 
 #include <uhd/stream.hpp>
+#include <complex>
+#include <functional>
 #include <set>
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#define IHD_HAS_COROUTINES 1 /* ipsolon_rx_stream::async_recv() is available */
+#endif
 #include "ipsolon_chdr_header.h"
+#include "transport/frame_buff.hpp"
 
 namespace ihd {
     class ipsolon_rx_stream : public uhd::rx_streamer {
@@ -23,6 +30,47 @@ namespace ihd {
 
         typedef std::shared_ptr<ipsolon_rx_stream> sptr;
 
+        /*!
+         * Stream counters since the stream was created. recv_calls is the number of receive system calls
+         * that returned data, so packets / recv_calls is the average number of packets per syscall.
+         * Sequence numbers are compared per channel and modulo 2^16, so the wrap from 0xffff to 0 is not a loss.
+         */
+        struct stream_stats_t {
+            uint64_t packets;          /* Datagrams received */
+            uint64_t recv_calls;
+            uint64_t bytes;            /* Datagram payload bytes received */
+            uint64_t dropped_packets;  /* Sequence numbers skipped by the packets handed to the application */
+            uint64_t reorder_events;   /* Packets that arrived after a packet sent later */
+            uint64_t free_starvation;  /* Times a receive thread had no free packet to receive into */
+            uint64_t queue_high_water; /* Most packets waiting in a receive thread's sample queue */
+            uint64_t socket_drops;     /* Datagrams the kernel dropped for lack of socket buffer (SO_RXQ_OVFL) */
+            uint64_t overflow_drops;   /* Packets dropped by the OVERFLOW_POLICY_KEY policy */
+            uint64_t pool_packets;     /* Packets in the receive packet pool */
+            uint64_t pool_bytes;       /* Memory of the receive packet pool */
+            uint64_t socket_buffer;    /* SO_RCVBUF granted to each receive socket, 0 before the stream starts or with AF_PACKET */
+        };
+
+        /*!
+         * Read-only view of a received packet, valid until the packet callback returns
+         */
+        struct packet_view_t {
+            chdr_header chdr;
+            uint64_t timestamp;                    /* ns */
+            const std::complex<int16_t> *samples; /* sc16 payload, in place in the packet pool */
+            size_t nsamps;
+        };
+
+        /*!
+         * Called on a receive thread with the packets one receive call returned, in arrival order
+         */
+        typedef std::function<void(const packet_view_t *packets, size_t n)> packet_callback_t;
+
+        /*!
+         * Called once by async_wait_ready(): ready is true when recv() may have something to return,
+         * false when the stream stopped first
+         */
+        typedef std::function<void(bool ready)> ready_callback_t;
+
         class stream_type {
         public:
             static const std::string STREAM_FORMAT_KEY;
@@ -36,6 +84,33 @@ namespace ihd {
             static const std::string FFT_AVG_COUNT_KEY;
             static const std::string FFT_SIZE_KEY;
 
+            // receive thread parameters
+            static const std::string RECV_BATCH_KEY; /* Max packets per recvmmsg() call */
+            static const std::string HUGE_PAGES_KEY; /* "true" to back the packet pool with huge pages */
+            static const std::string RECV_BACKEND_KEY; /* SOCKET_BACKEND (default), AF_PACKET_BACKEND or URING_BACKEND */
+            static const std::string SOCKET_BACKEND;
+            static const std::string AF_PACKET_BACKEND;
+            static const std::string URING_BACKEND; /* Falls back to SOCKET_BACKEND without kernel support */
+            static const std::string RECV_CPU_KEY; /* Pin the receive thread to this CPU */
+            static const std::string RECV_PRIORITY_KEY; /* SCHED_FIFO priority of the receive thread */
+            static const std::string BUSY_POLL_KEY; /* SO_BUSY_POLL time in usec, prefer busy polling */
+            static const std::string RECV_SPIN_KEY; /* "true" to spin on the socket instead of blocking */
+            static const std::string RECV_THREADS_KEY; /* Receive threads (and sockets) sharing the VITA port */
+            static const std::string RECV_STEERING_KEY; /* How datagrams are spread over the receive threads */
+            static const std::string SEQ_STEERING; /* By CHDR sequence number (default) */
+            static const std::string HASH_STEERING; /* By the kernel's flow hash */
+            static const std::string OVERFLOW_POLICY_KEY; /* What the receive thread does when the application holds every packet */
+            static const std::string BLOCK_OVERFLOW; /* Wait for a free packet, the socket buffer overflows (default) */
+            static const std::string DROP_NEWEST_OVERFLOW; /* Keep receiving, drop what was just received */
+            static const std::string DROP_OLDEST_OVERFLOW; /* Keep receiving, take back the oldest queued packets */
+            static const std::string SAMPLE_RATE_KEY; /* Expected samples (FFT bins for psd) per second per channel */
+            static const std::string BUFFER_TIME_KEY; /* Milliseconds of samples to buffer, needs SAMPLE_RATE_KEY */
+            static const std::string BUFFER_BYTES_KEY; /* Packet pool memory budget, caps BUFFER_TIME_KEY */
+            static const std::string REACTOR_THREADS_KEY; /* Receive on the process wide epoll reactor, started with
+                                                           * this many threads, instead of the stream's own threads */
+            static const std::string NUMA_NODE_KEY; /* Node of the packet pool and receive threads, -1 for none.
+                                                     * Defaults to the node of the VITA interface */
+
             explicit stream_type(const std::string &st) {
                 if (_modes.find(st) == _modes.end()) {
                     throw uhd::key_error("Invalid stream mode:" + st);
@@ -57,7 +132,115 @@ namespace ihd {
             std::string _stream_mode_str;
         };
 
+        [[nodiscard]] virtual stream_stats_t get_stats() const = 0;
+
+        /*!
+         * File descriptor for the application's own poll()/epoll loop, readable (POLLIN) when recv() or
+         * get_recv_buff() may have something to return. Receive with a timeout of 0, which returns at once,
+         * until nothing is returned: that re-arms it. It can be readable with nothing to receive.
+         * The stream owns the descriptor, it is never readable while a packet callback is set.
+         */
+        virtual int get_ready_fd() = 0;
+
+        /*!
+         * Call callback once recv() may have something to return, on the receive thread that queued the
+         * packet (or on the calling thread if packets are already waiting), so it should only hand the work
+         * off. Like get_ready_fd() the wakeup can be spurious. Stopping the stream calls it with false.
+         * One callback at a time, and never while a packet callback is set.
+         * \throws uhd::runtime_error if a callback is already waiting
+         */
+        virtual void async_wait_ready(ready_callback_t callback) = 0;
+
+        /*!
+         * Hand every received packet to callback on the receive thread that received it, instead of
+         * queueing it for recv(). The packets go back to the pool as soon as the callback returns,
+         * so there is no queue, lock or copy between the socket and the callback.
+         * With RECV_THREADS > 1 the callback runs on several threads at once and the packets are not
+         * put back in sequence order. A slow callback backs up into the socket buffer.
+         * Only while the stream is stopped, an empty callback goes back to recv().
+         */
+        virtual void set_packet_callback(packet_callback_t callback) = 0;
+
+        /*!
+         * Zero-copy alternative to recv(): borrow the payload of the next packet where it was received.
+         * data() points at packet_size() bytes of sc16 samples. Every buffer must be given back with
+         * release_recv_buff() before the stream is destroyed, held buffers are not available to the receiver.
+         * A multi-channel stream returns the packets of all its channels in arrival order.
+         * \param metadata filled in as for recv()
+         * \param timeout seconds to wait for a packet
+         * \return the payload, or a null uptr on timeout
+         */
+        virtual transport::frame_buff::uptr get_recv_buff(uhd::rx_metadata_t &metadata, double timeout) = 0;
+
+        /*!
+         * Return a buffer from get_recv_buff() to the stream
+         */
+        virtual void release_recv_buff(transport::frame_buff::uptr buff) = 0;
+
         static sptr make(const uhd::stream_args_t &stream_cmd, const uhd::device_addr_t &_device_addr);
+
+#ifdef IHD_HAS_COROUTINES
+        /*! Runs a function on the application's thread or thread pool, e.g. a boost::asio::post() wrapper */
+        typedef std::function<void(std::function<void()> work)> executor_t;
+
+        /*!
+         * co_await-able recv() built on async_wait_ready(), see async_recv()
+         */
+        class recv_awaitable {
+        public:
+            recv_awaitable(ipsolon_rx_stream &stream, const buffs_type &buffs, size_t nsamps_per_buff,
+                           uhd::rx_metadata_t &metadata, executor_t executor, bool one_packet) :
+                _stream(stream), _buffs(buffs), _nsamps_per_buff(nsamps_per_buff), _metadata(metadata),
+                _executor(std::move(executor)), _one_packet(one_packet) {}
+
+            bool await_ready() {
+                _nsamps = _stream.recv(_buffs, _nsamps_per_buff, _metadata, 0.0, _one_packet);
+                return _nsamps > 0;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle) {
+                _handle = handle;
+                wait();
+            }
+
+            size_t await_resume() const { return _nsamps; }
+
+        private:
+            void wait() {
+                _stream.async_wait_ready([this](bool ready) {
+                    // Off the receive thread before touching the stream
+                    _executor([this, ready] {
+                        _nsamps = _stream.recv(_buffs, _nsamps_per_buff, _metadata, 0.0, _one_packet);
+                        if (_nsamps == 0 && ready) {
+                            wait(); // Spurious wakeup
+                        } else {
+                            _handle.resume();
+                        }
+                    });
+                });
+            }
+
+            ipsolon_rx_stream &_stream;
+            const buffs_type &_buffs; /* Temporaries of the co_await expression live until it resumes */
+            size_t _nsamps_per_buff;
+            uhd::rx_metadata_t &_metadata;
+            executor_t _executor;
+            bool _one_packet;
+            size_t _nsamps{};
+            std::coroutine_handle<> _handle;
+        };
+
+        /*!
+         * recv() for coroutines: co_await returns the number of samples, without blocking a thread while
+         * there is nothing to receive. The coroutine is resumed through executor, never on the receive thread.
+         * When the stream stops first it resumes with 0 samples and a timeout error in metadata.
+         * One async_recv() at a time, and the stream must outlive it.
+         */
+        recv_awaitable async_recv(const buffs_type &buffs, size_t nsamps_per_buff, uhd::rx_metadata_t &metadata,
+                                  executor_t executor, bool one_packet = false) {
+            return {*this, buffs, nsamps_per_buff, metadata, std::move(executor), one_packet};
+        }
+#endif
     };
 } // ihd
 
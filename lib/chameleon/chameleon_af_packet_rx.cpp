@@ -0,0 +1,279 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "chameleon_af_packet_rx.hpp"
+#include "chameleon_packet.hpp"
+#include "debug.hpp"
+
+using namespace ihd;
+
+static constexpr size_t IPV4_MIN_HEADER_SIZE = 20;
+static constexpr size_t IPV4_SOURCE_OFFSET = 12;
+static constexpr size_t UDP_HEADER_SIZE = 8;
+
+/* Layout of a TPACKET_V3 block header */
+struct chameleon_af_packet_rx::block_desc {
+    uint32_t version;
+    uint32_t offset_to_priv;
+    tpacket_hdr_v1 h1;
+};
+
+chameleon_af_packet_rx::chameleon_af_packet_rx(in_addr_t ip, uint16_t port, const timeval &timeout, int port_fd) :
+    _ip(ip),
+    _port(port),
+    _timeout_ms(static_cast<int>(timeout.tv_sec * 1000 + timeout.tv_usec / 1000)),
+    _port_fd(port_fd) {
+}
+
+chameleon_af_packet_rx::~chameleon_af_packet_rx() {
+    if (_ring != nullptr) {
+        munmap(_ring, _ring_size);
+    }
+    if (_socket_fd > -1) {
+        close(_socket_fd);
+    }
+    if (_port_fd > -1) {
+        close(_port_fd);
+    }
+}
+
+bool chameleon_af_packet_rx::open() {
+    // SOCK_DGRAM: the link layer header is stripped, the filter and tp_net both start at the IP header
+    _socket_fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+    if (_socket_fd < 0) {
+        perror("AF_PACKET socket creation failed (needs CAP_NET_RAW)");
+        return false;
+    }
+    if (!attach_filter()) {
+        return false;
+    }
+
+    int ignore_outgoing = 1;
+    if (setsockopt(_socket_fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignore_outgoing, sizeof(ignore_outgoing)) < 0) {
+        dbfprintf(stderr, "PACKET_IGNORE_OUTGOING not supported, locally sent datagrams are seen twice\n");
+    }
+
+    int version = TPACKET_V3;
+    if (setsockopt(_socket_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        perror("PACKET_VERSION set error");
+        return false;
+    }
+
+    tpacket_req3 req{};
+    req.tp_block_size = BLOCK_SIZE;
+    req.tp_block_nr = BLOCK_CNT;
+    req.tp_frame_size = FRAME_SIZE;
+    req.tp_frame_nr = (BLOCK_SIZE / FRAME_SIZE) * BLOCK_CNT;
+    req.tp_retire_blk_tov = BLOCK_RETIRE_MS;
+    if (setsockopt(_socket_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        perror("PACKET_RX_RING set error");
+        return false;
+    }
+
+    _ring_size = static_cast<size_t>(BLOCK_SIZE) * BLOCK_CNT;
+    void *ring = mmap(nullptr, _ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _socket_fd, 0);
+    if (ring == MAP_FAILED) {
+        perror("PACKET_RX_RING mmap failed");
+        return false;
+    }
+    _ring = static_cast<uint8_t *>(ring);
+
+    sockaddr_ll local_addr{};
+    local_addr.sll_family = AF_PACKET;
+    local_addr.sll_protocol = htons(ETH_P_IP);
+    local_addr.sll_ifindex = get_ifindex();
+    if (bind(_socket_fd, reinterpret_cast<const sockaddr *>(&local_addr), sizeof(local_addr)) < 0) {
+        perror("AF_PACKET bind failed");
+        return false;
+    }
+    if (_fanout_mode >= 0) {
+        int fanout = _fanout_group | (_fanout_mode << 16);
+        if (setsockopt(_socket_fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0) {
+            perror("PACKET_FANOUT set error");
+            return false;
+        }
+    }
+
+    if (_port_fd > -1) {
+        // The datagrams are read from the ring, don't let them pile up in the UDP socket as well
+        int optval = 0;
+        setsockopt(_port_fd, SOL_SOCKET, SO_RCVBUF, &optval, sizeof(optval));
+    }
+    dbprintf("AF_PACKET ring: %u blocks of %u bytes, ifindex:%d\n", BLOCK_CNT, BLOCK_SIZE, local_addr.sll_ifindex);
+    return true;
+}
+
+void chameleon_af_packet_rx::set_fanout(uint16_t group_id, uint16_t mode) {
+    _fanout_group = group_id;
+    _fanout_mode = mode;
+}
+
+int chameleon_af_packet_rx::get_ifindex() const {
+    int ifindex = 0;
+    ifaddrs *ifas = nullptr;
+    if (_ip != INADDR_ANY && getifaddrs(&ifas) == 0) {
+        for (ifaddrs *ifa = ifas; ifa != nullptr; ifa = ifa->ifa_next) {
+            if (ifa->ifa_addr != nullptr && ifa->ifa_addr->sa_family == AF_INET &&
+                reinterpret_cast<const sockaddr_in *>(ifa->ifa_addr)->sin_addr.s_addr == _ip) {
+                ifindex = static_cast<int>(if_nametoindex(ifa->ifa_name));
+                break;
+            }
+        }
+        freeifaddrs(ifas);
+    }
+    return ifindex;
+}
+
+bool chameleon_af_packet_rx::attach_filter() const {
+    // Classic BPF over the IP header: IPv4/UDP, not a fragment, destination port (and address).
+    // Every rejecting jump lands on the final return 0.
+    const uint32_t ip = ntohl(_ip);
+    sock_filter code[] = {
+        /* 0 */ BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+        /* 1 */ BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+        /* 2 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 4, 0, 10),          // IPv4
+        /* 3 */ BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),
+        /* 4 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 8), // UDP
+        /* 5 */ BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6),
+        /* 6 */ BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x3fff, 6, 0),     // MF or fragment offset
+        /* 7 */ BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),
+        /* 8 */ BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),
+        /* 9 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, _port, 0, 3),       // UDP destination port
+        /* 10 */ BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 16),
+        /* 11 */ BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ip, 0, 1),         // IP destination address
+        /* 12 */ BPF_STMT(BPF_RET | BPF_K, UINT32_MAX),
+        /* 13 */ BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    if (_ip == INADDR_ANY) {
+        // Accept any destination address
+        code[10] = BPF_STMT(BPF_RET | BPF_K, UINT32_MAX);
+    }
+    sock_fprog prog{};
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    if (setsockopt(_socket_fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+        perror("SO_ATTACH_FILTER failed");
+        return false;
+    }
+    return true;
+}
+
+chameleon_af_packet_rx::block_desc *chameleon_af_packet_rx::get_block(size_t i) const {
+    return reinterpret_cast<block_desc *>(_ring + (i * BLOCK_SIZE));
+}
+
+int chameleon_af_packet_rx::wait_block(block_desc *bd) const {
+    pollfd pfd{};
+    pfd.fd = _socket_fd;
+    pfd.events = POLLIN | POLLERR;
+    while (!(__atomic_load_n(&bd->h1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+        if (_timeout_ms == 0) {
+            return 0; // Spinning, the caller checks the block again
+        }
+        int err = poll(&pfd, 1, _timeout_ms);
+        if (err == 0) {
+            return 0; // Timeout
+        } else if (err < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+bool chameleon_af_packet_rx::copy_payload(const uint8_t *frame, chameleon_packet *cp) const {
+    const auto *hdr = reinterpret_cast<const tpacket3_hdr *>(frame);
+    if (hdr->tp_snaplen != hdr->tp_len || hdr->tp_net < hdr->tp_mac) {
+        return false; // Truncated
+    }
+    const uint8_t *ip = frame + hdr->tp_net;
+    const size_t len = hdr->tp_snaplen - (hdr->tp_net - hdr->tp_mac);
+
+    // The filter has already checked version, protocol, fragmentation and destination
+    const size_t ihl = static_cast<size_t>(ip[0] & 0x0f) * 4;
+    if (ihl < IPV4_MIN_HEADER_SIZE || len < ihl + UDP_HEADER_SIZE) {
+        return false;
+    }
+    const uint8_t *udp = ip + ihl;
+    const size_t udp_len = (static_cast<size_t>(udp[4]) << 8) | udp[5];
+    if (udp_len < UDP_HEADER_SIZE || udp_len > len - ihl) {
+        return false;
+    }
+    const size_t payload_len = udp_len - UDP_HEADER_SIZE;
+    if (payload_len < ipsolon_rx_stream::PACKET_HEADER_SIZE) {
+        return false; // No room for the CHDR header and timestamp
+    }
+    if (payload_len > cp->getBufferSize()) {
+        return false; // recvmmsg() would have truncated it
+    }
+    memcpy(cp->getPacketMem(), udp + UDP_HEADER_SIZE, payload_len);
+    cp->setPacketSize(payload_len);
+    uint32_t source;
+    memcpy(&source, ip + IPV4_SOURCE_OFFSET, sizeof(source));
+    cp->setSource(source);
+    return true;
+}
+
+int chameleon_af_packet_rx::receive(chameleon_packet **packets, size_t n) {
+    size_t filled = 0;
+    while (filled < n) {
+        block_desc *bd = get_block(_block);
+        if (_block_remaining == 0) {
+            if (!(__atomic_load_n(&bd->h1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+                if (filled > 0) {
+                    break; // Return what we have rather than wait for the next block
+                }
+                int ready = wait_block(bd);
+                if (ready <= 0) {
+                    return ready;
+                }
+            }
+            _block_remaining = bd->h1.num_pkts;
+            _losing |= (bd->h1.block_status & TP_STATUS_LOSING) != 0;
+            _frame = reinterpret_cast<const uint8_t *>(bd) + bd->h1.offset_to_first_pkt;
+        }
+
+        if (_block_remaining > 0) {
+            if (copy_payload(_frame, packets[filled])) {
+                filled++;
+            }
+            _frame += reinterpret_cast<const tpacket3_hdr *>(_frame)->tp_next_offset;
+            _block_remaining--;
+        }
+        if (_block_remaining == 0) {
+            // Hand the block back to the kernel
+            __atomic_store_n(&bd->h1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+            _block = (_block + 1) % BLOCK_CNT;
+        }
+    }
+    return static_cast<int>(filled);
+}
+
+uint64_t chameleon_af_packet_rx::get_drops() {
+    if (_losing) {
+        // Reading the statistics resets them, so accumulate
+        tpacket_stats_v3 stats{};
+        socklen_t len = sizeof(stats);
+        if (getsockopt(_socket_fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0) {
+            _drops += stats.tp_drops;
+        }
+        _losing = false;
+    }
+    return _drops;
+}
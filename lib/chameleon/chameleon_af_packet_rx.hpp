@@ -0,0 +1,102 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_AF_PACKET_RX_HPP
+#define CHAMELEON_AF_PACKET_RX_HPP
+#include <cstdint>
+#include <netinet/in.h>
+#include <sys/time.h>
+
+#include "chameleon_rx_backend.hpp"
+
+namespace ihd {
+    /*!
+     * AF_PACKET TPACKET_V3 backend.
+     *
+     * The kernel writes frames straight into a PACKET_RX_RING shared with this process and hands it whole
+     * blocks at a time, so a busy stream costs one poll() per block instead of one syscall per datagram.
+     * A BPF program attached to the socket drops everything that is not IPv4/UDP to the VITA port
+     * (and address, unless it is INADDR_ANY). IP and UDP headers are parsed here and only the UDP payload
+     * is copied into the packets, so the stream sees exactly what the socket backend would give it.
+     *
+     * Needs CAP_NET_RAW. Binds to the interface that owns the VITA address, or to every interface when
+     * the address is not local (INADDR_ANY, broadcast). The ring only sees whole datagrams, so IQ packets
+     * must fit the link MTU (jumbo frames) - IP fragments are dropped by the filter.
+     */
+    class chameleon_af_packet_rx : public chameleon_rx_backend {
+    public:
+        static constexpr uint32_t BLOCK_SIZE = 1 << 20;
+        static constexpr uint32_t BLOCK_CNT = 48;
+        static constexpr uint32_t FRAME_SIZE = 1 << 14; /* Only used to size the ring, V3 frames are variable */
+        static constexpr uint32_t BLOCK_RETIRE_MS = 4;  /* Hand a partly filled block to user space after this */
+
+        /*!
+         * \param timeout how long receive() waits for a block, zero to spin on the block status without poll()
+         * \param port_fd UDP socket bound to the VITA port or -1. It is never read, it only keeps the host
+         *                from answering every datagram with ICMP port unreachable. Closed by the destructor.
+         */
+        chameleon_af_packet_rx(in_addr_t ip, uint16_t port, const timeval &timeout, int port_fd);
+
+        ~chameleon_af_packet_rx() override;
+
+        chameleon_af_packet_rx(const chameleon_af_packet_rx &) = delete;
+        chameleon_af_packet_rx &operator=(const chameleon_af_packet_rx &) = delete;
+
+        /*!
+         * Create the socket, ring and filter
+         * \return false on failure, the reason has been printed
+         */
+        bool open();
+
+        /*!
+         * Join a PACKET_FANOUT group before open(), so the sockets of the group share the datagrams
+         * instead of each seeing all of them
+         * \param group_id fanout group, the same for every socket of the stream
+         * \param mode PACKET_FANOUT_LB, PACKET_FANOUT_HASH, ...
+         */
+        void set_fanout(uint16_t group_id, uint16_t mode);
+
+        int receive(chameleon_packet **packets, size_t n) override;
+
+        /*! Frames dropped because the ring was full, only asks the kernel after a block was flagged as losing */
+        uint64_t get_drops() override;
+
+        [[nodiscard]] int get_fd() const override { return _socket_fd; }
+
+    private:
+        struct block_desc;
+
+        in_addr_t _ip;
+        uint16_t _port;
+        int _timeout_ms;
+        int _port_fd;
+        uint16_t _fanout_group{};
+        int _fanout_mode{-1}; /* -1 when not in a fanout group */
+
+        int _socket_fd{-1};
+        uint8_t *_ring{};
+        size_t _ring_size{};
+
+        size_t _block{};            /* Block being read */
+        uint32_t _block_remaining{}; /* Frames left in it, 0 when it has not been claimed yet */
+        const uint8_t *_frame{};    /* Next frame in it */
+        bool _losing{};             /* A block was retired with TP_STATUS_LOSING since the last get_drops() */
+        uint64_t _drops{};
+
+        [[nodiscard]] block_desc *get_block(size_t i) const;
+
+        [[nodiscard]] int get_ifindex() const;
+
+        bool attach_filter() const;
+
+        /*! \return 1 when the block belongs to user space, 0 on timeout, -1 on error */
+        int wait_block(block_desc *bd) const;
+
+        bool copy_payload(const uint8_t *frame, chameleon_packet *cp) const;
+    };
+} // ihd
+
+#endif //CHAMELEON_AF_PACKET_RX_HPP
@@ -0,0 +1,211 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHAMELEON_CONVERTER_X86
+#endif
+
+#include "chameleon_converter.hpp"
+#include <exception.hpp>
+
+using namespace ihd;
+
+static constexpr double SC16_FULL_SCALE = 32767.0;
+static constexpr double SC8_FULL_SCALE = 127.0;
+
+/***********************************************************************
+ * Generic kernels, also used for the tail of the SIMD kernels
+ **********************************************************************/
+static void sc16_to_sc16(const int16_t *in, void *out, size_t n_samples, double) {
+    memcpy(out, in, n_samples * 2 * sizeof(int16_t));
+}
+
+static void sc16_to_fc32_generic(const int16_t *in, void *out, size_t n_samples, double scale) {
+    auto *f = static_cast<float *>(out);
+    const auto s = static_cast<float>(scale);
+    for (size_t i = 0; i < n_samples * 2; i++) {
+        f[i] = static_cast<float>(in[i]) * s;
+    }
+}
+
+static void sc16_to_fc64_generic(const int16_t *in, void *out, size_t n_samples, double scale) {
+    auto *d = static_cast<double *>(out);
+    for (size_t i = 0; i < n_samples * 2; i++) {
+        d[i] = static_cast<double>(in[i]) * scale;
+    }
+}
+
+static void sc16_to_sc8_generic(const int16_t *in, void *out, size_t n_samples, double scale) {
+    auto *c = static_cast<int8_t *>(out);
+    const auto s = static_cast<float>(scale);
+    for (size_t i = 0; i < n_samples * 2; i++) {
+        float v = std::nearbyint(static_cast<float>(in[i]) * s);
+        c[i] = static_cast<int8_t>(std::min(std::max(v, -128.0f), 127.0f));
+    }
+}
+
+#ifdef CHAMELEON_CONVERTER_X86
+/***********************************************************************
+ * x86 kernels, n_samples complex samples are 2 * n_samples int16_t
+ **********************************************************************/
+__attribute__((target("sse2")))
+static void sc16_to_fc32_sse2(const int16_t *in, void *out, size_t n_samples, double scale) {
+    auto *f = static_cast<float *>(out);
+    const size_t n = n_samples * 2;
+    const __m128 s = _mm_set1_ps(static_cast<float>(scale));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        // Sign extend by unpacking into the high half and shifting back down
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(f + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), s));
+        _mm_storeu_ps(f + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), s));
+    }
+    sc16_to_fc32_generic(in + i, f + i, (n - i) / 2, scale);
+}
+
+__attribute__((target("avx2")))
+static void sc16_to_fc32_avx2(const int16_t *in, void *out, size_t n_samples, double scale) {
+    auto *f = static_cast<float *>(out);
+    const size_t n = n_samples * 2;
+    const __m256 s = _mm256_set1_ps(static_cast<float>(scale));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        const __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(v));
+        const __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1));
+        _mm256_storeu_ps(f + i, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), s));
+        _mm256_storeu_ps(f + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), s));
+    }
+    sc16_to_fc32_generic(in + i, f + i, (n - i) / 2, scale);
+}
+
+__attribute__((target("avx512f")))
+static void sc16_to_fc32_avx512(const int16_t *in, void *out, size_t n_samples, double scale) {
+    auto *f = static_cast<float *>(out);
+    const size_t n = n_samples * 2;
+    const __m512 s = _mm512_set1_ps(static_cast<float>(scale));
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i + 16));
+        _mm512_storeu_ps(f + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(lo)), s));
+        _mm512_storeu_ps(f + i + 16, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(hi)), s));
+    }
+    sc16_to_fc32_generic(in + i, f + i, (n - i) / 2, scale);
+}
+
+__attribute__((target("avx2")))
+static void sc16_to_fc64_avx2(const int16_t *in, void *out, size_t n_samples, double scale) {
+    auto *d = static_cast<double *>(out);
+    const size_t n = n_samples * 2;
+    const __m256d s = _mm256_set1_pd(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)));
+        _mm256_storeu_pd(d + i, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), s));
+        _mm256_storeu_pd(d + i + 4, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), s));
+    }
+    sc16_to_fc64_generic(in + i, d + i, (n - i) / 2, scale);
+}
+
+__attribute__((target("avx2")))
+static void sc16_to_sc8_avx2(const int16_t *in, void *out, size_t n_samples, double scale) {
+    auto *c = static_cast<int8_t *>(out);
+    const size_t n = n_samples * 2;
+    const __m256 s = _mm256_set1_ps(static_cast<float>(scale));
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+        const __m256 lo = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v))), s);
+        const __m256 hi = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1))), s);
+        // Round, then saturate 32 -> 16 -> 8 bits. The 256 bit pack works per 128 bit lane, the permute undoes that.
+        __m256i w = _mm256_packs_epi32(_mm256_cvtps_epi32(lo), _mm256_cvtps_epi32(hi));
+        w = _mm256_permute4x64_epi64(w, 0xd8);
+        const __m128i b = _mm_packs_epi16(_mm256_castsi256_si128(w), _mm256_extracti128_si256(w, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(c + i), b);
+    }
+    sc16_to_sc8_generic(in + i, c + i, (n - i) / 2, scale);
+}
+#endif
+
+/***********************************************************************
+ * Registry
+ **********************************************************************/
+namespace {
+    enum class isa_t { GENERIC, SSE2, AVX2, AVX512F };
+
+    struct kernel_t {
+        const char *cpu_format;
+        isa_t isa;
+        const char *isa_name;
+        size_t bytes_per_sample;
+        double full_scale; /* Output value of a full scale sample, 0 for an unscaled copy */
+        chameleon_converter::convert_fn fn;
+    };
+
+    /* Fastest first, the generic kernel of each format comes last */
+    const kernel_t KERNELS[] = {
+        {"sc16", isa_t::GENERIC, "generic", 2 * sizeof(int16_t), 0.0, sc16_to_sc16},
+#ifdef CHAMELEON_CONVERTER_X86
+        {"fc32", isa_t::AVX512F, "avx512f", 2 * sizeof(float), 1.0, sc16_to_fc32_avx512},
+        {"fc32", isa_t::AVX2, "avx2", 2 * sizeof(float), 1.0, sc16_to_fc32_avx2},
+        {"fc32", isa_t::SSE2, "sse2", 2 * sizeof(float), 1.0, sc16_to_fc32_sse2},
+        {"fc64", isa_t::AVX2, "avx2", 2 * sizeof(double), 1.0, sc16_to_fc64_avx2},
+        {"sc8", isa_t::AVX2, "avx2", 2 * sizeof(int8_t), SC8_FULL_SCALE, sc16_to_sc8_avx2},
+#endif
+        {"fc32", isa_t::GENERIC, "generic", 2 * sizeof(float), 1.0, sc16_to_fc32_generic},
+        {"fc64", isa_t::GENERIC, "generic", 2 * sizeof(double), 1.0, sc16_to_fc64_generic},
+        {"sc8", isa_t::GENERIC, "generic", 2 * sizeof(int8_t), SC8_FULL_SCALE, sc16_to_sc8_generic},
+    };
+
+    bool isa_supported(isa_t isa) {
+        switch (isa) {
+#ifdef CHAMELEON_CONVERTER_X86
+            case isa_t::SSE2: return __builtin_cpu_supports("sse2");
+            case isa_t::AVX2: return __builtin_cpu_supports("avx2");
+            case isa_t::AVX512F: return __builtin_cpu_supports("avx512f");
+#endif
+            case isa_t::GENERIC: return true;
+            default: return false;
+        }
+    }
+}
+
+chameleon_converter::chameleon_converter() : chameleon_converter("sc16", 1.0) {
+}
+
+chameleon_converter::chameleon_converter(const std::string &cpu_format, double fullscale) :
+    _fn(nullptr),
+    _scale(0.0),
+    _bytes_per_sample(0) {
+    for (const kernel_t &kernel: KERNELS) {
+        if (cpu_format == kernel.cpu_format && isa_supported(kernel.isa)) {
+            _fn = kernel.fn;
+            _scale = fullscale * kernel.full_scale / SC16_FULL_SCALE;
+            _bytes_per_sample = kernel.bytes_per_sample;
+            _isa = kernel.isa_name;
+            return;
+        }
+    }
+    THROW_VALUE_NOT_SUPPORTED_ERROR(cpu_format);
+}
+
+std::vector<std::string> chameleon_converter::get_cpu_formats() {
+    std::vector<std::string> formats;
+    for (const kernel_t &kernel: KERNELS) {
+        if (std::find(formats.begin(), formats.end(), kernel.cpu_format) == formats.end()) {
+            formats.emplace_back(kernel.cpu_format);
+        }
+    }
+    return formats;
+}
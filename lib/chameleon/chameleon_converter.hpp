@@ -0,0 +1,63 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_CONVERTER_HPP
+#define CHAMELEON_CONVERTER_HPP
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ihd {
+    /*!
+     * Converts the sc16 samples of a packet payload to the stream's cpu_format in a single pass.
+     *
+     * Every cpu_format has a plain C++ kernel and, on x86, SSE2/AVX2/AVX-512 kernels compiled with
+     * function target attributes. The constructor picks the fastest kernel the running CPU supports,
+     * so the library needs no special build flags.
+     *
+     * Float formats are scaled by fullscale / 32767 (as UHD does), sc8 is scaled to fullscale * 127
+     * and saturated, sc16 is copied as is.
+     */
+    class chameleon_converter {
+    public:
+        /*!
+         * \param in n_samples complex sc16 samples (2 * n_samples int16_t, I first)
+         * \param out n_samples complex samples of the cpu_format
+         */
+        typedef void (*convert_fn)(const int16_t *in, void *out, size_t n_samples, double scale);
+
+        /*! sc16 copy */
+        chameleon_converter();
+
+        /*!
+         * \param cpu_format sc16, sc8, fc32 or fc64
+         * \param fullscale amplitude of a full scale sample in a float format
+         * \throws value_not_supported for an unknown cpu_format
+         */
+        chameleon_converter(const std::string &cpu_format, double fullscale);
+
+        void operator()(const int16_t *in, void *out, size_t n_samples) const {
+            _fn(in, out, n_samples, _scale);
+        }
+
+        [[nodiscard]] size_t get_bytes_per_sample() const { return _bytes_per_sample; }
+
+        /*! Instruction set of the selected kernel, e.g. "avx2" */
+        [[nodiscard]] const std::string &get_isa() const { return _isa; }
+
+        /*! The cpu_formats a converter can be made for */
+        static std::vector<std::string> get_cpu_formats();
+
+    private:
+        convert_fn _fn;
+        double _scale;
+        size_t _bytes_per_sample;
+        std::string _isa;
+    };
+} // ihd
+
+#endif //CHAMELEON_CONVERTER_HPP
@@ -6,54 +6,310 @@
 
 #include "chameleon_fw_commander.hpp"
 
+#include <algorithm>
+#include <climits>
 #include <utility>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include "chameleon_fw_common.hpp"
 #include "debug.hpp"
 #include <atomic>
+#include <exception.hpp>
 
 namespace ihd
 {
     static std::atomic<size_t> _seq(1);
 
-    chameleon_fw_commander::chameleon_fw_commander(uhd::device_addr_t da) : _dev_addr(std::move(da))
+    chameleon_fw_commander::sptr chameleon_fw_commander::get(const uhd::device_addr_t &dev_addr)
     {
-        _udp_cmd_port = uhd::transport::udp_simple::make_connected(_dev_addr["addr"],
-                                                                   std::to_string(CHAMELEON_FW_COMMS_UDP_PORT));
+        static std::mutex instances_mtx;
+        static std::unordered_map<std::string, std::weak_ptr<chameleon_fw_commander>> instances; /* By "addr" */
+
+        std::lock_guard<std::mutex> const lock(instances_mtx);
+        std::weak_ptr<chameleon_fw_commander> &instance = instances[dev_addr["addr"]];
+        sptr commander = instance.lock();
+        if (!commander)
+        {
+            commander = sptr(new chameleon_fw_commander(dev_addr));
+            instance = commander;
+        }
+        return commander;
+    }
+
+    chameleon_fw_commander::chameleon_fw_commander(uhd::device_addr_t da) : _dev_addr(std::move(da)),
+        _next_deadline(std::chrono::steady_clock::time_point::max())
+    {
+        _socket = transport::open_udp_socket(_dev_addr["addr"], std::to_string(CHAMELEON_FW_COMMS_UDP_PORT),
+                                             _io_service);
+        _sock_fd = _socket->native_handle();
+        _wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (_wake_fd < 0)
+        {
+            THROW_SOCKET_ERROR();
+        }
+        _thread = std::thread([this] { receive_thread_func(); });
+    }
+
+    chameleon_fw_commander::~chameleon_fw_commander()
+    {
+        _run = false;
+        wake();
+        _thread.join();
+        close(_wake_fd);
+
+        // Nobody will answer these any more
+        expire(std::chrono::steady_clock::time_point::max());
     }
 
     int chameleon_fw_commander::send_request(chameleon_fw_comms& request, size_t timeout_ms) const
     {
-        int err = 0;
-        size_t ret = 0;
+        return send_request_async(request, timeout_ms).get();
+    }
 
-        std::lock_guard<std::mutex> const lock(_mutex);
+    std::future<int> chameleon_fw_commander::send_request_async(chameleon_fw_comms& request, size_t timeout_ms) const
+    {
+        std::future<int> result = add_request(request, timeout_ms);
 
-        request.setSequence(_seq++);
-        std::string const str = request.getCommandString();
-        ret = _udp_cmd_port->send(boost::asio::buffer(str.c_str(), str.length()));
-        if (ret != str.length())
+        int err = 0;
+        try
         {
-            dbfprintf(stderr, "_udp_cmd_port->send FAILED ret: %lu\n", ret);
+            transport::send_udp_packet(_sock_fd, const_cast<char *>(request.getCommandString()),
+                                      request.getCommandSize());
+        }
+        catch (const uhd::io_error &e)
+        {
+            dbfprintf(stderr, "_udp_cmd_port->send FAILED: %s\n", e.what());
             err = -1;
         }
-        else if (timeout_ms > 0)
+
+        if (timeout_ms == 0)
         {
-            // Send passed and the caller wants to wait for a response
-            char response[CHAMELEON_FW_CMD_MAX_SIZE] = {0};
-            ret = _udp_cmd_port->recv(boost::asio::buffer(response), (static_cast<double>(timeout_ms) / 1000.0));
-            if (!ret)
+            std::promise<int> sent;
+            sent.set_value(err);
+            result = sent.get_future();
+        }
+        else if (err)
+        {
+            fail_request(request.getSequence(), err);
+        }
+        return result;
+    }
+
+    std::vector<int> chameleon_fw_commander::send_requests(const std::vector<chameleon_fw_comms *> &requests,
+                                                           size_t timeout_ms) const
+    {
+        const size_t n = requests.size();
+        std::vector<std::future<int>> results(n);
+        std::vector<iovec> iovs(n);
+        std::vector<mmsghdr> msgs(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            results[i] = add_request(*requests[i], timeout_ms);
+            iovs[i].iov_base = const_cast<char *>(requests[i]->getCommandString());
+            iovs[i].iov_len = requests[i]->getCommandSize();
+            msgs[i] = mmsghdr{};
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        size_t sent = 0;
+        while (sent < n)
+        {
+            // Sends at most UIO_MAXIOV datagrams per call
+            const int ret = sendmmsg(_sock_fd, &msgs[sent], static_cast<unsigned int>(n - sent), 0);
+            if (ret > 0)
+            {
+                sent += static_cast<size_t>(ret);
+            }
+            else if (ret < 0 && errno == ENOBUFS)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(1));
+            }
+            else if (ret < 0 && errno != EINTR)
+            {
+                perror("commander sendmmsg failed");
+                break;
+            }
+        }
+
+        std::vector<int> errs(n, -1);
+        for (size_t i = 0; i < n; i++)
+        {
+            if (i >= sent)
             {
-                // Timeout
-                request.setResponseTimedOut();
-                dbprintf("timeout for %s\n", str.c_str());
-                err = -1;
+                if (timeout_ms > 0)
+                {
+                    fail_request(requests[i]->getSequence(), -1);
+                }
             }
             else
             {
-                request.setResponse(response);
+                errs[i] = (timeout_ms > 0) ? results[i].get() : 0;
             }
         }
-        return err;
+        return errs;
+    }
+
+    std::future<int> chameleon_fw_commander::add_request(chameleon_fw_comms &request, size_t timeout_ms) const
+    {
+        const auto seq = static_cast<uint32_t>(_seq++);
+
+        request.setSequence(seq);
+        if (timeout_ms == 0)
+        {
+            return std::future<int>();
+        }
+        // Before sending, the response can arrive before send() returns
+        std::future<int> result;
+        bool earlier;
+        {
+            std::lock_guard<std::mutex> const lock(_mutex);
+            pending_request_t &pending = _pending[seq];
+            pending.request = &request;
+            pending.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            result = pending.done.get_future();
+            earlier = pending.deadline < _next_deadline;
+            if (earlier)
+            {
+                _next_deadline = pending.deadline;
+            }
+        }
+        if (earlier)
+        {
+            wake(); // The receive thread sleeps past this deadline
+        }
+        return result;
+    }
+
+    void chameleon_fw_commander::wake() const
+    {
+        uint64_t one = 1;
+        if (write(_wake_fd, &one, sizeof(one)) < 0)
+        {
+            perror("commander wake failed");
+        }
+    }
+
+    int chameleon_fw_commander::poll_timeout_ms() const
+    {
+        std::lock_guard<std::mutex> const lock(_mutex);
+        _next_deadline = std::chrono::steady_clock::time_point::max();
+        for (const auto &seq_pending: _pending)
+        {
+            _next_deadline = std::min(_next_deadline, seq_pending.second.deadline);
+        }
+        if (_next_deadline == std::chrono::steady_clock::time_point::max())
+        {
+            return -1;
+        }
+        const auto wait_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            _next_deadline - std::chrono::steady_clock::now()).count();
+        // Rounded up, waking just before the deadline would only poll again
+        const auto wait_ms = (wait_us + 999) / 1000;
+        if (wait_ms <= 0)
+        {
+            return 0;
+        }
+        return (wait_ms > INT_MAX) ? INT_MAX : static_cast<int>(wait_ms);
+    }
+
+    void chameleon_fw_commander::fail_request(uint32_t seq, int err) const
+    {
+        std::lock_guard<std::mutex> const lock(_mutex);
+        auto it = _pending.find(seq);
+        if (it != _pending.end())
+        {
+            it->second.done.set_value(err);
+            _pending.erase(it);
+        }
+    }
+
+    void chameleon_fw_commander::receive_thread_func()
+    {
+        char response[CHAMELEON_FW_CMD_MAX_SIZE + 1];
+        pollfd fds[2] = {{_sock_fd, POLLIN, 0}, {_wake_fd, POLLIN, 0}};
+        while (_run)
+        {
+            const int n = poll(fds, 2, poll_timeout_ms());
+            if (n < 0 && errno != EINTR)
+            {
+                perror("commander poll failed");
+                break;
+            }
+            if (n > 0 && (fds[1].revents & POLLIN))
+            {
+                uint64_t count;
+                if (read(_wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                {
+                    perror("commander wake read failed");
+                }
+            }
+            if (n > 0 && (fds[0].revents & POLLIN))
+            {
+                ssize_t len;
+                while ((len = recv(_sock_fd, response, CHAMELEON_FW_CMD_MAX_SIZE, MSG_DONTWAIT)) > 0)
+                {
+                    response[len] = '\0';
+                    complete(response);
+                }
+            }
+            expire(std::chrono::steady_clock::now());
+        }
+    }
+
+    void chameleon_fw_commander::complete(const char *response)
+    {
+        const uint32_t seq = chameleon_fw_comms::parseSequence(response);
+        pending_request_t pending;
+        {
+            std::lock_guard<std::mutex> const lock(_mutex);
+            auto it = _pending.find(seq);
+            if (seq == 0 && _pending.size() == 1)
+            {
+                // No usable sequence number, let setResponse() decide what it is
+                it = _pending.begin();
+            }
+            // A sequence number that isn't pending is a late reply to a request that timed out
+            if (it == _pending.end())
+            {
+                dbprintf("dropped response: %s\n", response);
+                return;
+            }
+            pending = std::move(it->second);
+            _pending.erase(it);
+        }
+        pending.request->setResponse(response);
+        pending.done.set_value(0);
+    }
+
+    void chameleon_fw_commander::expire(const std::chrono::steady_clock::time_point &now)
+    {
+        std::vector<pending_request_t> expired;
+        {
+            std::lock_guard<std::mutex> const lock(_mutex);
+            for (auto it = _pending.begin(); it != _pending.end();)
+            {
+                if (it->second.deadline <= now)
+                {
+                    expired.push_back(std::move(it->second));
+                    it = _pending.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+        for (pending_request_t &pending: expired)
+        {
+            // Timeout
+            pending.request->setResponseTimedOut();
+            dbprintf("timeout for %s\n", pending.request->getCommandString());
+            pending.done.set_value(-1);
+        }
     }
 
     const char* chameleon_fw_commander::getIP()
@@ -7,22 +7,113 @@
 #ifndef CHAMELEON_FW_CMD_HPP
 #define CHAMELEON_FW_CMD_HPP
 #include <uhd/device.hpp>
-#include <uhd/transport/udp_simple.hpp>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "chameleon_fw_common.hpp"
+#include "transport/udp_common.hpp"
 
 namespace ihd {
 
+/*!
+ * Sends firmware commands and matches the responses to them by sequence number.
+ *
+ * Any number of requests can be in flight: a receive thread hands every response to the request with its
+ * sequence number and fails the requests whose timeout has passed. Responses that arrive after their
+ * request timed out are dropped. The thread sleeps until the earliest deadline, or until woken when
+ * nothing is pending.
+ *
+ * The device and its streams share one commander (and receive thread) per device address, see get().
+ */
 class chameleon_fw_commander {
 public:
-    explicit chameleon_fw_commander(uhd::device_addr_t  dev_addr);
+    typedef std::shared_ptr<chameleon_fw_commander> sptr;
+
+    /*!
+     * The commander of dev_addr's "addr", created by the first caller and closed when the last one lets go
+     * \throws uhd::io_error if the socket can't be opened
+     */
+    static sptr get(const uhd::device_addr_t &dev_addr);
+
+    ~chameleon_fw_commander();
+
+    chameleon_fw_commander(const chameleon_fw_commander &) = delete;
+    chameleon_fw_commander &operator=(const chameleon_fw_commander &) = delete;
+
+    /*!
+     * Send request and wait for its response
+     * \param timeout_ms 0 to send without waiting for a response
+     * \return 0 when the response (ACK or NAK) is in request, -1 on send error or timeout
+     */
     int send_request(chameleon_fw_comms &request, size_t timeout_ms = 5000) const;
+
+    /*!
+     * Send request and return without waiting, request must stay alive until the future is ready
+     * \param timeout_ms 0 to send without waiting for a response, the future is then ready at once
+     * \return the future of what send_request() would return
+     */
+    std::future<int> send_request_async(chameleon_fw_comms &request, size_t timeout_ms = 5000) const;
+
+    /*!
+     * Send every request back to back (with sendmmsg()) and wait for all their responses, so the batch
+     * takes about one round trip instead of one per request
+     * \return what send_request() would return for each request, in order
+     */
+    std::vector<int> send_requests(const std::vector<chameleon_fw_comms *> &requests,
+                                   size_t timeout_ms = 5000) const;
+
     const char *getIP();
+
 private:
-    uhd::transport::udp_simple::sptr _udp_cmd_port{};
+    typedef struct pending_request {
+        chameleon_fw_comms *request;
+        std::promise<int> done;
+        std::chrono::steady_clock::time_point deadline;
+    } pending_request_t;
+
+    /*!
+     * Give request the next sequence number and, unless timeout_ms is 0, wait for its response
+     * \return the future of the response, invalid if timeout_ms is 0
+     */
+    std::future<int> add_request(chameleon_fw_comms &request, size_t timeout_ms) const;
+
+    explicit chameleon_fw_commander(uhd::device_addr_t dev_addr);
+
+    /*! Wake the receive thread, e.g. to wait for an earlier deadline */
+    void wake() const;
+
+    /*! How long the receive thread may sleep: until the earliest deadline, -1 (forever) if nothing is pending */
+    int poll_timeout_ms() const;
+
+    /*! Fail a request that could not be sent */
+    void fail_request(uint32_t seq, int err) const;
+
+    void receive_thread_func();
+
+    /*! Hand a response to its request */
+    void complete(const char *response);
+
+    /*! Fail the requests whose deadline is before now */
+    void expire(const std::chrono::steady_clock::time_point &now);
+
     uhd::device_addr_t _dev_addr;
-    mutable std::mutex _mutex;
+    boost::asio::io_service _io_service;
+    transport::socket_sptr _socket;
+    int _sock_fd{-1};
+    int _wake_fd{-1};
+
+    mutable std::mutex _mutex; /* Guards _pending and _next_deadline */
+    mutable std::unordered_map<uint32_t, pending_request_t> _pending; /* By sequence number */
+    mutable std::chrono::steady_clock::time_point _next_deadline; /* The receive thread wakes up by then */
+    std::atomic<bool> _run{true};
+    std::thread _thread;
 };
 
 } // ihd
@@ -5,13 +5,85 @@
 */
 #include "chameleon_fw_common.hpp"
 #include "debug.hpp"
+#include "exception.hpp"
 #include <iostream>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
 
 namespace ihd {
 
 const char *chameleon_fw_comms::ACK_STR = "ACK";
 const char *chameleon_fw_comms::NCK_STR = "NCK";
 
+/*! Write value in base 10 or 16 into buf, which must hold 20 chars, return the length */
+static size_t format_uint(char *buf, uint64_t value, const bool hex) {
+    const unsigned base = hex ? 16 : 10;
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[n++] = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value > 0);
+    for (size_t i = 0; i < n; i++) {
+        buf[i] = digits[n - 1 - i];
+    }
+    return n;
+}
+
+chameleon_fw_cmd::chameleon_fw_cmd(const char *cmd) : _cmd(cmd) {
+    _text[0] = '\0';
+    append(cmd, strlen(cmd));
+}
+
+void chameleon_fw_cmd::append(const char *str, const size_t len) {
+    if (_size + len >= MAX_SIZE) {
+        THROW_VALUE_NOT_SUPPORTED_ERROR(std::string(_cmd) + " command longer than " + std::to_string(MAX_SIZE));
+    }
+    memcpy(_text + _size, str, len);
+    _size += len;
+    _text[_size] = '\0';
+}
+
+void chameleon_fw_cmd::appendKey(const char *key) {
+    if (_num_fields++ == 0) {
+        append(" ", 1);
+    } else {
+        append(", ", 2);
+    }
+    append(key, strlen(key));
+    append("=", 1);
+}
+
+void chameleon_fw_cmd::appendField(const char *key, const uint64_t value, const bool hex) {
+    char buf[20];
+    appendKey(key);
+    append(buf, format_uint(buf, value, hex));
+}
+
+void chameleon_fw_cmd::appendField(const char *key, const int64_t value, const bool hex) {
+    char buf[21];
+    appendKey(key);
+    if (value < 0) {
+        buf[0] = '-';
+        append(buf, 1 + format_uint(buf + 1, 0 - static_cast<uint64_t>(value), hex));
+    } else {
+        append(buf, format_uint(buf, static_cast<uint64_t>(value), hex));
+    }
+}
+
+void chameleon_fw_cmd::appendField(const char *key, const double value, bool) {
+    // %g is what the firmware has always been sent, the default format of an ostream
+    char buf[32];
+    appendKey(key);
+    append(buf, static_cast<size_t>(snprintf(buf, sizeof(buf), "%g", value)));
+}
+
+void chameleon_fw_cmd::appendField(const char *key, const char *value, bool) {
+    appendKey(key);
+    append(value, strlen(value));
+}
+
 [[nodiscard]]
 uint32_t chameleon_fw_comms::getSequence() const {
     return _sequence;
@@ -19,94 +91,104 @@ uint32_t chameleon_fw_comms::getSequence() const {
 
 void chameleon_fw_comms::setSequence(uint32_t sequence) {
     _sequence = sequence;
+    _command_size = 0;
+    if (_sequence > 0) {
+        _command_size = format_uint(_command_string, _sequence, false);
+        _command_string[_command_size++] = ' ';
+    }
+    memcpy(_command_string + _command_size, _command.to_command_string(), _command.size() + 1);
+    _command_size += _command.size();
 }
 
-std::string chameleon_fw_comms::getCommandString() const {
-    std::stringstream ss;
-    if (_sequence > 0) {
-        ss << _sequence << " ";
+char *chameleon_fw_comms::nextToken(char *&p, const char *seps) {
+    p += strspn(p, seps);
+    if (*p == '\0') {
+        return nullptr;
     }
-    ss << _command->to_command_string();
-    return ss.str();
+    char *token = p;
+    p += strcspn(p, seps);
+    if (*p != '\0') {
+        *p++ = '\0';
+    }
+    return token;
 }
 
-/**
-* @brief Tokenize the given vector according to the regex and remove the empty tokens.
-*
-* @param str
-* @param re
-* @return std::vector<std::string>
-*/
-std::vector <std::string> chameleon_fw_comms::tokenize(const std::string& str, const std::regex& re) {
-    std::sregex_token_iterator it{str.begin(), str.end(), re, -1};
-    std::vector <std::string> tokenized{it, {}};
-    // Additional check to remove empty strings
-    tokenized.erase(
-            std::remove_if(tokenized.begin(), tokenized.end(), [](std::string const &s) {
-                               return s.empty();
-                           }
-            ), tokenized.end());
-    return tokenized;
+char *chameleon_fw_comms::trim(char *str) {
+    if (str == nullptr) {
+        return nullptr;
+    }
+    while (isspace(static_cast<unsigned char>(*str))) {
+        str++;
+    }
+    char *end = str + strlen(str);
+    while (end > str && isspace(static_cast<unsigned char>(end[-1]))) {
+        *--end = '\0';
+    }
+    return str;
 }
 
+uint32_t chameleon_fw_comms::parseSequence(const char *response) {
+    const char *p = strchr(response, ',');
+    if (p == nullptr) {
+        return 0;
+    }
+    char *end;
+    const unsigned long seq = strtoul(p + 1, &end, 10);
+    // The command name follows, a number on its own is not a sequence number
+    if (end == p + 1 || !isspace(static_cast<unsigned char>(*end))) {
+        return 0;
+    }
+    return static_cast<uint32_t>(seq);
+}
 
 void chameleon_fw_comms::setResponse(const char *response) {
+    static const char *const SPACES = " \t\r\n";
     int err = 0;
 
-    const std::regex comma_regx(R"([,]+)");
-    const std::regex space_regx(R"([\s]+)");
-
     dbprintf("setResponse: %s\n", response);
-    const std::vector <std::string> tokenized = tokenize(std::string(response), comma_regx);
-    _response = tokenized;
-    if (tokenized.empty()) {
-        err = -1;
+    const size_t len = strnlen(response, CHAMELEON_FW_CMD_MAX_SIZE);
+    memcpy(_response, response, len);
+    _response[len] = '\0';
+    _num_fields = 0;
+
+    char *p = _response;
+    const char *status = trim(nextToken(p, ","));
+    if (status != nullptr && strcmp(status, ACK_STR) == 0) {
+        _result = Result::ACK;
+    } else if (status != nullptr && strcmp(status, NCK_STR) == 0) {
+        _result = Result::NAK;
     } else {
-        if (tokenized[0] == ACK_STR) {
-            _result = Result::ACK;
-        } else if(tokenized[0] == NCK_STR) {
-            _result = Result::NAK;
-        } else {
+        err = -1;
+    }
+    char *command = err ? nullptr : nextToken(p, ",");
+    if (command != nullptr) {
+        const char *cmd = nextToken(command, SPACES);
+        if (_sequence > 0 && cmd != nullptr) {
+            /* The response should include a leading sequence number: <seq> <cmd> */
+            char *end = nullptr;
+            if (strtoul(cmd, &end, 10) != _sequence || *end != '\0') {
+                err = -1;
+            }
+            cmd = nextToken(command, SPACES);
+        }
+        if (cmd == nullptr || nextToken(command, SPACES) != nullptr || strcmp(_command.getCommand(), cmd) != 0) {
             err = -1;
         }
     }
-    if (!err && tokenized.size() > 1) {
-        const auto& command_str = tokenized[1];
-        const std::vector <std::string> cmd_tokenized = tokenize(std::string(command_str), space_regx);
-        if (cmd_tokenized.empty()) {
-            err = -1;
-        }  else {
-            const char *cmd = nullptr;
-            if (_sequence > 0) {
-                /* The response should include a leading sequence number */
-                if (cmd_tokenized.size() != 2) {
-                    err = -1;
-                } else {
-                    cmd = cmd_tokenized[1].c_str(); /* <seq> <cmd> */
-                    try {
-                        auto response_sequence_number = static_cast<uint32_t>(std::stoul(cmd_tokenized[0]));
-                        if (response_sequence_number != _sequence) {
-                            err = -1;
-                        }
-                    } catch(...) {
-                        err = -1;
-                        std::exception_ptr const p = std::current_exception();
-                        dbfprintf(stderr, "%s\n",(p ? p.__cxa_exception_type()->name() : "null"));
-                    }
-                }
-            } else {
-                if (cmd_tokenized.size() != 1) {
-                    err = -1;
-                } else {
-                    /* No sequence number, just a command */
-                    cmd = cmd_tokenized[0].c_str();
-                }
+    if (!err) {
+        char *field;
+        while ((field = nextToken(p, ",")) != nullptr) {
+            if (_num_fields == MAX_FIELDS) {
+                dbfprintf(stderr, "setResponse: more than %zu fields, ignoring the rest\n", MAX_FIELDS);
+                break;
             }
-            if (!err && cmd != nullptr) {
-                if (strcmp(_command->getCommand(), cmd) != 0) {
-                    err = -1;
-                }
+            char *value = strchr(field, '=');
+            if (value == nullptr) {
+                value = field + strlen(field); /* "" */
+            } else {
+                *value++ = '\0';
             }
+            _fields[_num_fields++] = {trim(field), trim(value)};
         }
     }
     if (err) {
@@ -114,6 +196,78 @@ void chameleon_fw_comms::setResponse(const char *response) {
     }
 }
 
+const chameleon_fw_comms::field_t *chameleon_fw_comms::findField(const char *key) const {
+    for (size_t i = 0; i < _num_fields; i++) {
+        if (strcmp(_fields[i].key, key) == 0) {
+            return &_fields[i];
+        }
+    }
+    return nullptr;
+}
+
+bool chameleon_fw_comms::getValue(const size_t index, double &value) const {
+    return parseValue(getField(index), value);
+}
+
+bool chameleon_fw_comms::getValue(const size_t index, uint64_t &value) const {
+    return parseValue(getField(index), value);
+}
+
+bool chameleon_fw_comms::getValue(const size_t index, int64_t &value) const {
+    return parseValue(getField(index), value);
+}
+
+bool chameleon_fw_comms::getValue(const size_t index, const char *&value) const {
+    return parseValue(getField(index), value);
+}
+
+bool chameleon_fw_comms::parseValue(const field_t *field, double &value) {
+    if (field == nullptr) {
+        return false;
+    }
+    char *end = nullptr;
+    const double v = strtod(field->value, &end);
+    if (end == field->value) {
+        return false;
+    }
+    value = v;
+    return true;
+}
+
+bool chameleon_fw_comms::parseValue(const field_t *field, uint64_t &value) {
+    if (field == nullptr) {
+        return false;
+    }
+    char *end = nullptr;
+    const unsigned long long v = strtoull(field->value, &end, 10);
+    if (end == field->value) {
+        return false;
+    }
+    value = v;
+    return true;
+}
+
+bool chameleon_fw_comms::parseValue(const field_t *field, int64_t &value) {
+    if (field == nullptr) {
+        return false;
+    }
+    char *end = nullptr;
+    const long long v = strtoll(field->value, &end, 10);
+    if (end == field->value) {
+        return false;
+    }
+    value = v;
+    return true;
+}
+
+bool chameleon_fw_comms::parseValue(const field_t *field, const char *&value) {
+    if (field == nullptr) {
+        return false;
+    }
+    value = field->value;
+    return true;
+}
+
 void chameleon_fw_comms::setResponseTimedOut() {
     printf("Timeout waiting for response\n");
     _result = Result::ERROR;
@@ -7,8 +7,8 @@
 #ifndef CHAMELEON_FW_COMMON_H
 #define CHAMELEON_FW_COMMON_H
 
-#include <sstream>
-#include <regex>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <utility>
 #include <vector>
@@ -18,381 +18,290 @@
 #define CHAMELEON_FW_CMD_MAX_SIZE     9000
 
 namespace ihd {
-    class chameleon_fw_cmd {
-    public:
-        explicit chameleon_fw_cmd(const char *cmd) : _cmd(cmd) {
-        }
-
-        virtual const char *to_command_string() = 0;
-
-        virtual ~chameleon_fw_cmd() = default;
-
-        const char *getCommand() const { return _cmd; }
-
-    protected:
-        const char *_cmd{};
-        std::string _command_string;
-        std::string _reply_string;
-    };
-
-    class chameleon_fw_cmd_tune : public chameleon_fw_cmd {
-    public:
-        chameleon_fw_cmd_tune(size_t c, uint64_t f, uint32_t cal) : chameleon_fw_cmd("freq_set"),
-                                                                    chan(c), freq(f), cal_mask(cal) {
-        }
-
-        const char *to_command_string() override {
-            std::stringstream ss;
-            ss << _cmd << " chan=" << chan << "," " freq=" << freq << ", calmask=" << std::hex << cal_mask;
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
-
-    private:
-        std::size_t chan{};
-        uint64_t freq{};
-        uint32_t cal_mask{};
+    class chameleon_fw_comms;
+
+/*! Declares a name or key of the command schema, CHAMELEON_FW_TOKEN(chan) writes "chan" */
+#define CHAMELEON_FW_TOKEN(t) struct t { static const char *str() { return #t; } }
+
+    namespace fw_name {
+        CHAMELEON_FW_TOKEN(freq_set);
+        CHAMELEON_FW_TOKEN(get_freq);
+        CHAMELEON_FW_TOKEN(set_txgain);
+        CHAMELEON_FW_TOKEN(get_txgain);
+        CHAMELEON_FW_TOKEN(set_rxgain);
+        CHAMELEON_FW_TOKEN(get_rxgain);
+        CHAMELEON_FW_TOKEN(stream_rm);
+        CHAMELEON_FW_TOKEN(stream_list);
+        CHAMELEON_FW_TOKEN(rx_cfg_set);
+        CHAMELEON_FW_TOKEN(stream_rx_cfg);
+        CHAMELEON_FW_TOKEN(stream_start);
+        CHAMELEON_FW_TOKEN(stream_stop);
+        CHAMELEON_FW_TOKEN(stream_stop_all);
+        CHAMELEON_FW_TOKEN(get_temps_all);
+        CHAMELEON_FW_TOKEN(set_time);
+        CHAMELEON_FW_TOKEN(get_time);
+    }
+
+    namespace fw_key {
+        /*! A reply field found by its position instead of its key */
+        struct positional { static const char *str() { return nullptr; } };
+
+        CHAMELEON_FW_TOKEN(chan);
+        CHAMELEON_FW_TOKEN(freq);
+        CHAMELEON_FW_TOKEN(calmask);
+        CHAMELEON_FW_TOKEN(gain);
+        CHAMELEON_FW_TOKEN(id);
+        CHAMELEON_FW_TOKEN(type);
+        CHAMELEON_FW_TOKEN(fft_size);
+        CHAMELEON_FW_TOKEN(avg);
+        CHAMELEON_FW_TOKEN(packet_size);
+        CHAMELEON_FW_TOKEN(chan_mask);
+        CHAMELEON_FW_TOKEN(ip);
+        CHAMELEON_FW_TOKEN(port);
+        CHAMELEON_FW_TOKEN(time);
+    }
+
+    /*! A typed "<key>=<value>" field of a command or of its reply */
+    template<typename Key, typename T, bool HEX = false>
+    struct fw_field {
+        typedef T type;
+
+        static const char *key() { return Key::str(); }
+
+        enum { hex = HEX };
     };
 
-    class chameleon_fw_cmd_tune_get : public chameleon_fw_cmd {
-    public:
-        explicit chameleon_fw_cmd_tune_get(std::size_t c) : chameleon_fw_cmd("get_freq"),
-                                                            chan(c) {
-        }
-
-        const char *to_command_string() override {
-            std::stringstream ss;
-            ss << _cmd << " chan=" << chan;
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
+    template<typename Key = fw_key::positional> using fw_uint = fw_field<Key, uint64_t>;
+    template<typename Key = fw_key::positional> using fw_int = fw_field<Key, int64_t>;
+    template<typename Key = fw_key::positional> using fw_hex = fw_field<Key, uint64_t, true>;
+    template<typename Key = fw_key::positional> using fw_real = fw_field<Key, double>;
+    template<typename Key = fw_key::positional> using fw_str = fw_field<Key, const char *>;
 
-    private:
-        std::size_t chan{};
+    /*! The fields of the ACK to a command */
+    template<typename... Fields>
+    struct fw_reply {
     };
 
-    class chameleon_fw_cmd_txgain : public chameleon_fw_cmd {
+    /*!
+     * Text of a firmware command: "<name> <key>=<value>, <key>=<value>, ...".
+     * It is written into a fixed buffer when the command is made, so a command is a plain value
+     * that is cheap to copy and never allocates.
+     */
+    class chameleon_fw_cmd {
     public:
-        chameleon_fw_cmd_txgain(std::size_t c, double g) : chameleon_fw_cmd("set_txgain"),
-                                                           chan(c), gain(g) {
-        }
+        static constexpr size_t MAX_SIZE = 256;
 
-        const char *to_command_string() override {
-            std::stringstream ss;
-            ss << _cmd << " chan=" << chan << "," " gain=" << gain;
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
-
-    private:
-        std::size_t chan{};
-        double gain{};
-    };
+        const char *getCommand() const { return _cmd; }
 
-    class chameleon_fw_cmd_get_txgain : public chameleon_fw_cmd {
-    public:
-        explicit chameleon_fw_cmd_get_txgain(std::size_t c) : chameleon_fw_cmd("get_txgain"),
-                                                              chan(c) {
-        }
+        const char *to_command_string() const { return _text; }
 
-        const char *to_command_string() override {
-            std::stringstream ss;
-            ss << _cmd << " chan=" << chan;
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
+        size_t size() const { return _size; }
 
-    private:
-        std::size_t chan{};
-    };
+    protected:
+        explicit chameleon_fw_cmd(const char *cmd);
 
-    class chameleon_fw_cmd_rxgain : public chameleon_fw_cmd {
-    public:
-        chameleon_fw_cmd_rxgain(std::size_t c, double g) : chameleon_fw_cmd("set_rxgain"),
-                                                           chan(c), gain(g) {
-        }
+        /*! \throws std::runtime_error if the command does not fit in MAX_SIZE */
+        void appendField(const char *key, uint64_t value, bool hex);
 
-        const char *to_command_string() override {
-            std::stringstream ss;
-            ss << _cmd << " chan=" << chan << "," " gain=" << gain;
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
+        void appendField(const char *key, int64_t value, bool hex);
 
-    private:
-        std::size_t chan{};
-        double gain{};
-    };
+        void appendField(const char *key, double value, bool hex);
 
-    class chameleon_fw_cmd_get_rxgain : public chameleon_fw_cmd {
-    public:
-        explicit chameleon_fw_cmd_get_rxgain(std::size_t c) : chameleon_fw_cmd("get_rxgain"),
-                                                              chan(c) {
-        }
-
-        const char *to_command_string() override {
-            std::stringstream ss;
-            ss << _cmd << " chan=" << chan;
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
+        void appendField(const char *key, const char *value, bool hex);
 
     private:
-        std::size_t chan{};
-    };
-
-    class chameleon_fw_stream_remove : public chameleon_fw_cmd {
-    public:
-        explicit chameleon_fw_stream_remove(std::uint32_t stream_id) : chameleon_fw_cmd("stream_rm"),
-                                                                       stream_id(stream_id) {
-        }
+        void appendKey(const char *key);
 
-        const char *to_command_string() override {
-            std::stringstream ss;
-            ss << _cmd << " id=" << stream_id;
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
+        void append(const char *str, size_t len);
 
-    private:
-        std::uint32_t stream_id{};
+        const char *_cmd{};
+        char _text[MAX_SIZE];
+        size_t _size{};
+        size_t _num_fields{};
     };
 
-    class chameleon_fw_stream_list : public chameleon_fw_cmd {
-    public:
-        chameleon_fw_stream_list() : chameleon_fw_cmd("stream_list") {
-        }
-
-        const char *to_command_string() override {
-            std::stringstream ss;
-            ss << _cmd;
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
-    };
+    /*!
+     * A command described by its schema: the name, the fields of its reply and the fields it is
+     * made of, in the order they are sent. The constructor takes one value per field.
+     */
+    template<typename Name, typename Reply, typename... Fields>
+    class chameleon_fw_command;
 
-    class chameleon_fw_rx_cfg_set : public chameleon_fw_cmd {
+    template<typename Name, typename... Replies, typename... Fields>
+    class chameleon_fw_command<Name, fw_reply<Replies...>, Fields...> : public chameleon_fw_cmd {
     public:
-        chameleon_fw_rx_cfg_set(const std::size_t chan, std::string data_type, const uint32_t fft_size,
-                                const uint8_t avg) : chameleon_fw_cmd("rx_cfg_set"),
-                                                     m_data_type(std::move(data_type)),
-                                                     m_fft_size(fft_size),
-                                                     m_avg(avg),
-                                                     m_chan(chan) {
-        }
-
-        chameleon_fw_rx_cfg_set(const std::size_t chan,
-                                std::string data_type, const uint16_t packet_size = 0) : chameleon_fw_cmd("rx_cfg_set"),
-                                                                                         m_data_type(
-                                                                                                 std::move(data_type)),
-                                                                                         m_packet_size(packet_size),
-                                                                                         m_chan(chan) {
+        explicit chameleon_fw_command(typename Fields::type... values) : chameleon_fw_cmd(Name::str()) {
+            const int expand[] = {0, (appendField(Fields::key(), values, Fields::hex), 0)...};
+            (void) expand;
         }
 
-        const char *to_command_string() override {
-            std::stringstream ss;
-            if (m_data_type == "psd") {
-                ss << _cmd << " chan=" << m_chan << ", type=" << m_data_type << ", fft_size=" << m_fft_size << ", avg="
-                   << m_avg;
-            } else if (m_data_type == "iq") {
-                ss << _cmd << " chan=" << m_chan << ", type=" << m_data_type << ", packet_size=" << m_packet_size;
-            } else {
-                dbfprintf(stderr, "Invalid stream type. Defaulting to psd");
-                ss << _cmd << " chan=" << m_chan << ", type=psd, fft_size=" << m_fft_size << ", avg=" << m_avg;
-            }
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
-
-    private:
-        std::string m_data_type;
-        uint32_t m_fft_size{};
-        uint16_t m_avg{};
-        uint16_t m_packet_size{};
-        std::size_t m_chan;
+        /*!
+         * Read the reply fields out of the response to this command
+         * \return false unless the response is an ACK with every field
+         */
+        static bool decode(const chameleon_fw_comms &request, typename Replies::type &... values);
     };
 
-    class chameleon_fw_stream_rx_cfg : public chameleon_fw_cmd {
-    public:
-        chameleon_fw_stream_rx_cfg(const std::size_t chan_mask, std::string ip,
-                                   const uint16_t port) : chameleon_fw_cmd("stream_rx_cfg"),
-                                                          m_dest_port(port),
-                                                          m_dest_ip_address(std::move(ip)),
-                                                          m_chan_mask(chan_mask) {
-        }
-
-        const char *to_command_string() override {
-            std::stringstream ss;
-            ss << _cmd << " chan_mask=" << m_chan_mask << ", ip=" << m_dest_ip_address << ", port=" << m_dest_port;
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
-
-    private:
-        uint16_t m_dest_port;
-        std::string m_dest_ip_address;
-        std::size_t m_chan_mask;
-    };
+    /* The commands: schema and reply */
+    typedef chameleon_fw_command<fw_name::freq_set, fw_reply<>,
+            fw_uint<fw_key::chan>, fw_uint<fw_key::freq>, fw_hex<fw_key::calmask>> chameleon_fw_cmd_tune;
+    typedef chameleon_fw_command<fw_name::get_freq, fw_reply<fw_real<>>,
+            fw_uint<fw_key::chan>> chameleon_fw_cmd_tune_get;
+    typedef chameleon_fw_command<fw_name::set_txgain, fw_reply<>,
+            fw_uint<fw_key::chan>, fw_real<fw_key::gain>> chameleon_fw_cmd_txgain;
+    typedef chameleon_fw_command<fw_name::get_txgain, fw_reply<fw_real<>>,
+            fw_uint<fw_key::chan>> chameleon_fw_cmd_get_txgain;
+    typedef chameleon_fw_command<fw_name::set_rxgain, fw_reply<>,
+            fw_uint<fw_key::chan>, fw_real<fw_key::gain>> chameleon_fw_cmd_rxgain;
+    typedef chameleon_fw_command<fw_name::get_rxgain, fw_reply<fw_real<>>,
+            fw_uint<fw_key::chan>> chameleon_fw_cmd_get_rxgain;
+    typedef chameleon_fw_command<fw_name::stream_rm, fw_reply<>,
+            fw_uint<fw_key::id>> chameleon_fw_stream_remove;
+    typedef chameleon_fw_command<fw_name::stream_list, fw_reply<>> chameleon_fw_stream_list;
+    typedef chameleon_fw_command<fw_name::rx_cfg_set, fw_reply<>,
+            fw_uint<fw_key::chan>, fw_str<fw_key::type>, fw_uint<fw_key::fft_size>,
+            fw_uint<fw_key::avg>> chameleon_fw_rx_cfg_set_psd;
+    typedef chameleon_fw_command<fw_name::rx_cfg_set, fw_reply<>,
+            fw_uint<fw_key::chan>, fw_str<fw_key::type>, fw_uint<fw_key::packet_size>> chameleon_fw_rx_cfg_set_iq;
+    typedef chameleon_fw_command<fw_name::stream_rx_cfg, fw_reply<fw_uint<fw_key::id>>,
+            fw_uint<fw_key::chan_mask>, fw_str<fw_key::ip>, fw_uint<fw_key::port>> chameleon_fw_stream_rx_cfg;
+    typedef chameleon_fw_command<fw_name::stream_start, fw_reply<>,
+            fw_uint<fw_key::id>> chameleon_fw_stream_start;
+    typedef chameleon_fw_command<fw_name::stream_stop, fw_reply<>,
+            fw_uint<fw_key::id>> chameleon_fw_stream_stop;
+    typedef chameleon_fw_command<fw_name::stream_stop_all, fw_reply<>> chameleon_fw_stream_stop_all;
+    // fpga=64.7719, trx1=63.0000, trx2=63.0000, top=52.5000, bottom=53.0000
+    typedef chameleon_fw_command<fw_name::get_temps_all, fw_reply<>> chameleon_fw_get_temps_all;
+    typedef chameleon_fw_command<fw_name::set_time, fw_reply<>,
+            fw_int<fw_key::time>> chameleon_fw_set_time;
+    typedef chameleon_fw_command<fw_name::get_time, fw_reply<fw_real<>>> chameleon_fw_get_time;
 
-    class chameleon_fw_stream_start : public chameleon_fw_cmd {
+    class chameleon_fw_comms {
     public:
-        explicit chameleon_fw_stream_start(const std::size_t id) : chameleon_fw_cmd("stream_start"),
-                                                                   m_stream_id(id) {
+        chameleon_fw_comms(uint32_t sequence, const chameleon_fw_cmd &command) : _command(command),
+                                                                                 _result(NONE) {
+            setSequence(sequence);
         }
 
-        const char *to_command_string() override {
-            std::stringstream ss;
-            ss << _cmd << " id=" << m_stream_id;
-            _command_string = ss.str();
-            return _command_string.c_str();
+        explicit chameleon_fw_comms(const chameleon_fw_cmd &command) : chameleon_fw_comms(0, command) {
         }
 
-    private:
-        std::size_t m_stream_id;
-    };
-
-    class chameleon_fw_stream_stop : public chameleon_fw_cmd {
-    public:
-        explicit chameleon_fw_stream_stop(const std::size_t chan) : chameleon_fw_cmd("stream_stop"),
-                                                                    m_chan(chan) {
-        }
-
-        const char *to_command_string() override {
-            std::stringstream ss;
-            ss << _cmd << " id=" << m_chan;
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
+        virtual ~chameleon_fw_comms() = default;
 
-    private:
-        std::size_t m_chan;
-    };
+        /* The fields point into the object */
+        chameleon_fw_comms(const chameleon_fw_comms &) = delete;
+        chameleon_fw_comms &operator=(const chameleon_fw_comms &) = delete;
 
-    class chameleon_fw_stream_stop_all : public chameleon_fw_cmd {
-    public:
-        explicit chameleon_fw_stream_stop_all() :
-            chameleon_fw_cmd("stream_stop_all") {}
+        [[nodiscard]]
+        uint32_t getSequence() const;
 
-        const char *to_command_string() override {
-            return _cmd;
-        }
-    };
+        /*! Set the sequence number and write the command string with it */
+        void setSequence(uint32_t sequence);
 
-    // fpga=64.7719, trx1=63.0000, trx2=63.0000, top=52.5000, bottom=53.0000
-    class chameleon_fw_get_temps_all : public chameleon_fw_cmd {
-    public:
-        explicit chameleon_fw_get_temps_all() : chameleon_fw_cmd("get_temps_all") {}
+        /*! The command as sent: "[<seq> ]<command>" */
+        const char *getCommandString() const { return _command_string; }
 
-        const char *to_command_string() override { return _cmd; }
-    };
+        size_t getCommandSize() const { return _command_size; }
 
-    class chameleon_fw_set_time : public chameleon_fw_cmd {
-    public:
-        explicit chameleon_fw_set_time(int64_t t) : chameleon_fw_cmd("set_time"), time_value(t) {}
+        /*!
+         * Sequence number of a response ("ACK,<seq> <cmd>,...")
+         * \return 0 if it has none
+         */
+        static uint32_t parseSequence(const char *response);
 
-        const char *to_command_string() override {
-            std::stringstream ss;
-            ss << _cmd << " time=" << time_value;
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
+        /*!
+         * Parse a response ("<ACK|NCK>,[<seq> ]<cmd>,<key>=<value>,...") into the result and fields.
+         * The response is copied and split in place, nothing is allocated.
+         */
+        void setResponse(const char *response);
 
-    private:
-        int64_t time_value;
-    };
+        void setResponseTimedOut();
 
-    class chameleon_fw_get_time : public chameleon_fw_cmd {
-    public:
-        explicit chameleon_fw_get_time() : chameleon_fw_cmd("get_time") {}
+        enum Result {
+            NONE, /* No result/response yet (default value) */
+            ACK,
+            NAK,
+            ERROR /* Invalid response, timeout, etc. */
+        };
 
-        const char *to_command_string() override { return _cmd; }
-    };
+        Result getResult() const { return _result; }
 
-    class chameleon_fw_cmd_stream : public chameleon_fw_cmd {
-    public:
-        explicit chameleon_fw_cmd_stream(uint32_t chan_mask, bool enable, const char *ip, uint16_t port,
-                                         uint32_t size, uint32_t avg) : chameleon_fw_cmd(_cmd_str),
-                                                                        _chan_mask(chan_mask), _enable(enable),
-                                                                        _ip_addr(ip), _port(port),
-                                                                        _fft_size(size), _avg(avg) {
-        }
+        /*! A field of the response, whitespace trimmed. value is "" when the field has no '=' */
+        typedef struct field {
+            const char *key;
+            const char *value;
+        } field_t;
 
-        explicit chameleon_fw_cmd_stream(bool enable, uint32_t chan_mask) : chameleon_fw_cmd(_cmd_str),
-                                                                            _chan_mask(chan_mask), _enable(enable),
-                                                                            _ip_addr(), _port(0),
-                                                                            _fft_size(0), _avg(0) {
-        }
+        static constexpr size_t MAX_FIELDS = 64;
 
-        const char *to_command_string() override {
-            std::stringstream ss;
-            if (_enable) {
-                ss << _cmd << "_start chan_mask=" << _chan_mask << ", ip=" << _ip_addr
-                   << ", port=" << _port << ", fft_size="
-                   << _fft_size << ", avg=" << _avg;
-            } else {
-                ss << _cmd << "_stop chan_mask=" << _chan_mask;
-            }
-            _command_string = ss.str();
-            return _command_string.c_str();
-        }
+        size_t getNumFields() const { return _num_fields; }
 
-    private:
-        constexpr static const char *const _cmd_str = "stream";
-        uint32_t _chan_mask{};
-        bool _enable{};
-        std::string _ip_addr{};
-        uint16_t _port{};
-        uint32_t _fft_size{};
-        uint32_t _avg{};
-    };
+        /*!
+         * The index'th field after the command, valid until the next setResponse()
+         * \return nullptr if the response has no such field
+         */
+        const field_t *getField(size_t index) const { return index < _num_fields ? &_fields[index] : nullptr; }
 
-    class chameleon_fw_comms {
-    public:
-        chameleon_fw_comms(uint32_t sequence, std::unique_ptr<chameleon_fw_cmd> command) : _sequence(sequence),
-                                                                                           _command(std::move(command)),
-                                                                                           _result(NONE) {
-        }
+        /*! The first field named key, nullptr if there is none */
+        const field_t *findField(const char *key) const;
 
-        explicit chameleon_fw_comms(std::unique_ptr<chameleon_fw_cmd> command) : _sequence(0),
-                                                                                 _command(std::move(command)),
-                                                                                 _result(NONE) {
-        }
+        /*!
+         * The value of the index'th field as a number
+         * \return false if there is no such field or its value is not a number
+         */
+        bool getValue(size_t index, double &value) const;
 
-        virtual ~chameleon_fw_comms() = default;
+        bool getValue(size_t index, uint64_t &value) const;
 
-        [[nodiscard]]
-        uint32_t getSequence() const;
+        bool getValue(size_t index, int64_t &value) const;
 
-        void setSequence(uint32_t sequence);
+        bool getValue(size_t index, const char *&value) const;
 
-        std::string getCommandString() const;
+        /*! The value of the field named key, see getValue(size_t, double &) */
+        template<typename T>
+        bool getValue(const char *key, T &value) const { return parseValue(findField(key), value); }
 
-        static std::vector<std::string> tokenize(const std::string &str, const std::regex &re);
+    private:
+        /*! Split off the next non-empty token ending at one of seps, nullptr when there are none left */
+        static char *nextToken(char *&p, const char *seps);
 
-        void setResponse(const char *response);
+        /*! Strip leading and trailing whitespace in place, nullptr stays nullptr */
+        static char *trim(char *str);
 
-        void setResponseTimedOut();
+        static bool parseValue(const field_t *field, double &value);
 
-        enum Result {
-            NONE, /* No result/response yet (default value) */
-            ACK,
-            NAK,
-            ERROR /* Invalid response, timeout, etc. */
-        };
+        static bool parseValue(const field_t *field, uint64_t &value);
 
-        Result getResult() const { return _result; }
+        static bool parseValue(const field_t *field, int64_t &value);
 
-        std::vector<std::string> getResponse() const { return _response; }
+        static bool parseValue(const field_t *field, const char *&value);
 
-    private:
         uint32_t _sequence{};
-        std::unique_ptr<chameleon_fw_cmd> _command{};
+        chameleon_fw_cmd _command;
+        char _command_string[chameleon_fw_cmd::MAX_SIZE + 16]; /* "<seq> " + the command */
+        size_t _command_size{};
         Result _result;
-        std::vector<std::string> _response;
+        char _response[CHAMELEON_FW_CMD_MAX_SIZE + 1]; /* The response, fields point into it */
+        field_t _fields[MAX_FIELDS];
+        size_t _num_fields{};
 
         static const char *ACK_STR;
         static const char *NCK_STR;
     };
+
+    template<typename Name, typename... Replies, typename... Fields>
+    bool chameleon_fw_command<Name, fw_reply<Replies...>, Fields...>::decode(const chameleon_fw_comms &request,
+                                                                             typename Replies::type &... values) {
+        if (request.getResult() != chameleon_fw_comms::ACK) {
+            return false;
+        }
+        bool ok = true;
+        size_t index = 0;
+        const int expand[] = {0, (ok = ok && (Replies::key() ? request.getValue(Replies::key(), values)
+                                                             : request.getValue(index, values)), index++, 0)...};
+        (void) expand;
+        return ok;
+    }
 };
 
 #endif //CHAMELEON_FW_COMMON_H
@@ -3,7 +3,8 @@
 *
 * SPDX-License-Identifier: GPL-3.0-or-later
 */
-#include <boost/algorithm/string/trim.hpp>
+#include <uhd/property_tree.hpp>
+
 #include "chameleon_isrp_impl.hpp"
 #include "chameleon_fw_common.hpp"
 #include "chameleon_jammer_block_ctrl.hpp"
@@ -12,8 +13,15 @@
 using namespace ihd;
 
 chameleon_isrp_impl::chameleon_isrp_impl(uhd::device::sptr dev,
-                                         const uhd::device_addr_t &dev_addr) : _dev(std::move(dev)),
-                                                                               _commander(dev_addr) {
+                                         const uhd::device_addr_t &dev_addr) :
+    _dev(std::move(dev)),
+    _commander(chameleon_fw_commander::get(dev_addr)) {
+    for (channel_settings_t &settings: _channel_settings) {
+        settings.freq = {FREQ_REFRESH, false, 0};
+        settings.rx_gain = {GAIN_REFRESH, false, 0};
+        settings.tx_gain = {GAIN_REFRESH, false, 0};
+    }
+    create_tree();
 }
 
 uhd::device::sptr chameleon_isrp_impl::get_device() {
@@ -30,11 +38,7 @@ uhd::tx_streamer::sptr chameleon_isrp_impl::get_tx_stream(const uhd::stream_args
 
 uhd::tune_result_t chameleon_isrp_impl::set_freq(const uhd::tune_request_t &tune_request, size_t chan) const {
     constexpr size_t rx_set_freq_timeout_ms = 5000;
-    constexpr uint32_t internal_path_delay_cal = 0x200;
-    constexpr uint32_t loopback_lo_delay_cal = 0x2000;
-    constexpr uint32_t qec_cal = 0x1000;
-    constexpr uint32_t default_cal = qec_cal | loopback_lo_delay_cal | internal_path_delay_cal;
-    uint32_t cal_mask = default_cal;
+    uint32_t cal_mask = DEFAULT_CAL;
 
     if (tune_request.args.has_key("calmask")) {
         cal_mask = stoi(tune_request.args["calmask"], nullptr, 16);
@@ -42,23 +46,28 @@ uhd::tune_result_t chameleon_isrp_impl::set_freq(const uhd::tune_request_t &tune
     if (tune_request.args.has_key("qec_cal")) {
         auto do_qec = tune_request.args["qec_cal"];
         if (do_qec == "true") {
-            cal_mask |= qec_cal;
+            cal_mask |= QEC_CAL;
         } else if (do_qec == "false") {
-            cal_mask &= ~qec_cal;
+            cal_mask &= ~QEC_CAL;
         }
     }
     uhd::tune_result_t tr{};
-    std::unique_ptr<chameleon_fw_cmd> tune_cmd(
-            new chameleon_fw_cmd_tune(chan, static_cast<uint64_t>(tune_request.rf_freq), cal_mask));
-
-    chameleon_fw_comms request(std::move(tune_cmd));
+    const auto freq = static_cast<uint64_t>(tune_request.rf_freq);
+    setting_t *freq_setting = get_setting(chan, &channel_settings_t::freq);
+    // A tune that calibrates is sent even to the current frequency
+    if (cal_mask == 0 && is_current(freq_setting, static_cast<double>(freq))) {
+        return tr;
+    }
+    chameleon_fw_comms request{chameleon_fw_cmd_tune(chan, freq, cal_mask)};
 
     // send request
-    _commander.send_request(request, rx_set_freq_timeout_ms);
+    _commander->send_request(request, rx_set_freq_timeout_ms);
+    const bool ok = request.getResult() == chameleon_fw_comms::ACK;
+    update_cached(freq_setting, static_cast<double>(freq), ok);
 
     dbprintf("set_freq response: \n");
-    for (const auto &token: request.getResponse()) {
-        dbprintf("%s\n", token.c_str());
+    for (size_t i = 0; i < request.getNumFields(); i++) {
+        dbprintf("%s=%s\n", request.getField(i)->key, request.getField(i)->value);
     }
     // TODO implement tune result
     return tr;
@@ -67,19 +76,20 @@ uhd::tune_result_t chameleon_isrp_impl::set_freq(const uhd::tune_request_t &tune
 double chameleon_isrp_impl::get_freq(size_t chan) const {
     constexpr size_t rx_get_freq_timeout_ms = 5000;
     double ret = -1;
+    setting_t *setting = get_setting(chan, &channel_settings_t::freq);
+    if (read_cached(setting, ret)) {
+        return ret;
+    }
 
-    std::unique_ptr<chameleon_fw_cmd> tune_cmd(
-            new chameleon_fw_cmd_tune_get(chan));
-
-    chameleon_fw_comms request(std::move(tune_cmd));
+    chameleon_fw_comms request{chameleon_fw_cmd_tune_get(chan)};
 
     // send request
-    _commander.send_request(request, rx_get_freq_timeout_ms);
+    _commander->send_request(request, rx_get_freq_timeout_ms);
 
-    auto result = request.getResult();
-    if (result == chameleon_fw_comms::ACK) {
-        std::string const x = request.getResponse().at(2);
-        ret = std::stod(x.substr(x.find('=') + 1));
+    if (chameleon_fw_cmd_tune_get::decode(request, ret)) {
+        update_cached(setting, ret, true);
+    } else {
+        ret = -1;
     }
     return ret;
 }
@@ -102,55 +112,65 @@ double chameleon_isrp_impl::get_tx_freq(size_t chan) {
 
 void chameleon_isrp_impl::set_rx_gain(double gain, const std::string &name, size_t chan) {
     constexpr size_t rx_set_gain_timeout_ms = 5000;
-    std::unique_ptr<chameleon_fw_cmd> gain_cmd(new chameleon_fw_cmd_rxgain(chan, gain));
-
-    chameleon_fw_comms request(std::move(gain_cmd));
+    setting_t *setting = get_setting(chan, &channel_settings_t::rx_gain);
+    if (is_current(setting, gain)) {
+        return;
+    }
+    chameleon_fw_comms request{chameleon_fw_cmd_rxgain(chan, gain)};
 
     // send request
-    _commander.send_request(request, rx_set_gain_timeout_ms);
+    _commander->send_request(request, rx_set_gain_timeout_ms);
+    update_cached(setting, gain, request.getResult() == chameleon_fw_comms::ACK);
 }
 
 double chameleon_isrp_impl::get_rx_gain(const std::string &name, size_t chan) {
     int err = 0;
     double ret = -1;
     constexpr size_t rx_get_gain_timeout_ms = 5000;
-    std::unique_ptr<chameleon_fw_cmd> gain_cmd(new chameleon_fw_cmd_get_rxgain(chan));
-
-    chameleon_fw_comms request(std::move(gain_cmd));
+    setting_t *setting = get_setting(chan, &channel_settings_t::rx_gain);
+    if (read_cached(setting, ret)) {
+        return ret;
+    }
+    chameleon_fw_comms request{chameleon_fw_cmd_get_rxgain(chan)};
 
     // send request
-    _commander.send_request(request, rx_get_gain_timeout_ms);
-    auto result = request.getResult();
-    if (result == chameleon_fw_comms::ACK) {
-        std::string const x = request.getResponse().at(2);
-        ret = std::stod(x.substr(x.find('=') + 1));
+    _commander->send_request(request, rx_get_gain_timeout_ms);
+    if (chameleon_fw_cmd_get_rxgain::decode(request, ret)) {
+        update_cached(setting, ret, true);
+    } else {
+        ret = -1;
     }
     return ret;
 }
 
 void chameleon_isrp_impl::set_tx_gain(double gain, const std::string &name, size_t chan) {
     constexpr int tx_set_gain_timeout_ms = 5000;
-    std::unique_ptr<chameleon_fw_cmd> gain_cmd(new chameleon_fw_cmd_txgain(chan, gain));
-
-    chameleon_fw_comms request(std::move(gain_cmd));
+    setting_t *setting = get_setting(chan, &channel_settings_t::tx_gain);
+    if (is_current(setting, gain)) {
+        return;
+    }
+    chameleon_fw_comms request{chameleon_fw_cmd_txgain(chan, gain)};
 
     // send request
-    _commander.send_request(request, tx_set_gain_timeout_ms);
+    _commander->send_request(request, tx_set_gain_timeout_ms);
+    update_cached(setting, gain, request.getResult() == chameleon_fw_comms::ACK);
 }
 
 double chameleon_isrp_impl::get_tx_gain(const std::string &name, size_t chan) {
     constexpr int tx_get_gain_timeout_ms = 5000;
     double ret = -1;
-    std::unique_ptr<chameleon_fw_cmd> gain_cmd(new chameleon_fw_cmd_get_txgain(chan));
-
-    chameleon_fw_comms request(std::move(gain_cmd));
+    setting_t *setting = get_setting(chan, &channel_settings_t::tx_gain);
+    if (read_cached(setting, ret)) {
+        return ret;
+    }
+    chameleon_fw_comms request{chameleon_fw_cmd_get_txgain(chan)};
 
     // send request
-    _commander.send_request(request, tx_get_gain_timeout_ms);
-    auto result = request.getResult();
-    if (result == chameleon_fw_comms::ACK) {
-        std::string const x = request.getResponse().at(2);
-        ret = std::stod(x.substr(x.find('=') + 1));
+    _commander->send_request(request, tx_get_gain_timeout_ms);
+    if (chameleon_fw_cmd_get_txgain::decode(request, ret)) {
+        update_cached(setting, ret, true);
+    } else {
+        ret = -1;
     }
     return ret;
 }
@@ -160,30 +180,21 @@ uhd::time_spec_t chameleon_isrp_impl::get_time_now(size_t mboard) {
 
     uhd::time_spec_t ts{};
 
-    std::unique_ptr<chameleon_fw_cmd> get_time_cmd(new chameleon_fw_get_time());
-    chameleon_fw_comms request(std::move(get_time_cmd));
-    _commander.send_request(request, timeout_ms);
+    chameleon_fw_comms request{chameleon_fw_get_time()};
+    _commander->send_request(request, timeout_ms);
 
-    auto result = request.getResult();
-    if (result == chameleon_fw_comms::ACK) {
-        const double seconds = 0.0;
-        auto resp = request.getResponse();
-        if (resp.size() >= 3) {
-            const auto& time_str = resp[2];
-            auto ret = std::stod(time_str.substr(time_str.find('=') + 1));
-            ts = uhd::time_spec_t(ret);
-        }
+    double seconds = 0.0;
+    if (chameleon_fw_get_time::decode(request, seconds)) {
+        ts = uhd::time_spec_t(seconds);
     }
     return ts;
 }
 
 void chameleon_isrp_impl::set_time_now(const uhd::time_spec_t &time_spec, size_t mboard) {
     constexpr int timeout_ms = 5000;
-    std::unique_ptr<chameleon_fw_cmd> set_time_cmd(new chameleon_fw_set_time(time_spec.get_full_secs()));
+    chameleon_fw_comms request{chameleon_fw_set_time(time_spec.get_full_secs())};
 
-    chameleon_fw_comms request(std::move(set_time_cmd));
-
-    _commander.send_request(request, timeout_ms);
+    _commander->send_request(request, timeout_ms);
     auto result = request.getResult();
     if (result != chameleon_fw_comms::ACK) {
         dbprintf("Request failed: %u", result);
@@ -191,33 +202,22 @@ void chameleon_isrp_impl::set_time_now(const uhd::time_spec_t &time_spec, size_t
 }
 
 int chameleon_isrp_impl::get_temperatures(temperature_t &temperatures, size_t timeout) {
-    std::unique_ptr<chameleon_fw_cmd> temp_cmd(new chameleon_fw_get_temps_all);
-    chameleon_fw_comms request(std::move(temp_cmd));
+    chameleon_fw_comms request{chameleon_fw_get_temps_all()};
 
-    auto err = _commander.send_request(request, timeout);
+    auto err = _commander->send_request(request, timeout);
     if (!err) {
-        for (const auto &token: request.getResponse()) {
-            std::string msg(token);
-            boost::algorithm::trim(msg);
-            dbprintf("%s\n", msg.c_str());
-
-            std::stringstream tokenStream(msg);
-            std::string key, value;
-            const char seperator = '=';
-            if (std::getline(tokenStream, key, seperator) && std::getline(tokenStream, value)) {
-                double double_value = 0.0;
-                try {
-                    double_value = std::stod(value);
-                    dbprintf("Converted double: %f\n", double_value);
-                } catch (const std::invalid_argument &e) {
-                    dbprintf("Invalid argument: %s\n", e.what());
-                    err = -1;
-                } catch (const std::out_of_range &e) {
-                    dbprintf("Out of range: %s\n", e.what());
-                    err = -1;
-                }
-                temperatures[key] = double_value;
+        for (size_t i = 0; i < request.getNumFields(); i++) {
+            const chameleon_fw_comms::field_t *field = request.getField(i);
+            dbprintf("%s=%s\n", field->key, field->value);
+            if (*field->value == '\0') {
+                continue;
+            }
+            double double_value = 0.0;
+            if (!request.getValue(i, double_value)) {
+                dbprintf("Invalid argument: %s\n", field->value);
+                err = -1;
             }
+            temperatures[field->key] = double_value;
         }
     }
     return err;
@@ -225,7 +225,111 @@ int chameleon_isrp_impl::get_temperatures(temperature_t &temperatures, size_t ti
 
 int chameleon_isrp_impl::stream_stop_all() {
     constexpr int timeout = 5000;
-    std::unique_ptr<chameleon_fw_cmd> stop_all(new chameleon_fw_stream_stop_all);
-    chameleon_fw_comms request(std::move(stop_all));
-    return _commander.send_request(request, timeout);
+    chameleon_fw_comms request{chameleon_fw_stream_stop_all()};
+    return _commander->send_request(request, timeout);
+}
+
+int chameleon_isrp_impl::set_rx_configs(const std::vector<rx_config_t> &configs, size_t timeout) {
+    typedef struct cached_set {
+        setting_t *setting;
+        double value;
+    } cached_set_t;
+
+    std::vector<std::unique_ptr<chameleon_fw_comms>> commands;
+    std::vector<cached_set_t> sets; /* What each command sets, to cache once it is ACKed */
+    std::vector<chameleon_fw_comms *> requests;
+    for (const rx_config_t &config: configs) {
+        // Tunes with DEFAULT_CAL calibrate, so they are always sent
+        const auto freq = static_cast<uint64_t>(config.freq);
+        commands.emplace_back(new chameleon_fw_comms(chameleon_fw_cmd_tune(config.chan, freq, DEFAULT_CAL)));
+        sets.push_back({get_setting(config.chan, &channel_settings_t::freq), static_cast<double>(freq)});
+        setting_t *gain_setting = get_setting(config.chan, &channel_settings_t::rx_gain);
+        if (!is_current(gain_setting, config.gain)) {
+            commands.emplace_back(new chameleon_fw_comms(chameleon_fw_cmd_rxgain(config.chan, config.gain)));
+            sets.push_back({gain_setting, config.gain});
+        }
+    }
+    for (const std::unique_ptr<chameleon_fw_comms> &command: commands) {
+        requests.push_back(command.get());
+    }
+
+    int err = 0;
+    const std::vector<int> errs = _commander->send_requests(requests, timeout);
+    for (size_t i = 0; i < requests.size(); i++) {
+        const bool ok = !errs[i] && requests[i]->getResult() == chameleon_fw_comms::ACK;
+        update_cached(sets[i].setting, sets[i].value, ok);
+        if (!ok) {
+            dbprintf("set_rx_configs: %s failed\n", requests[i]->getCommandString());
+            err = -1;
+        }
+    }
+    return err;
+}
+
+uhd::property_tree::sptr chameleon_isrp_impl::get_tree() const {
+    return _tree;
+}
+
+chameleon_isrp_impl::setting_t *chameleon_isrp_impl::get_setting(const size_t chan,
+                                                                 setting_t channel_settings_t::*setting) const {
+    if (chan < 1 || chan > ipsolon_rx_stream::MAX_RX_CHANNELS) {
+        return nullptr;
+    }
+    return &(_channel_settings[chan - 1].*setting);
+}
+
+bool chameleon_isrp_impl::is_current(const setting_t *setting, const double value) const {
+    if (setting == nullptr) {
+        return false;
+    }
+    std::lock_guard<std::mutex> const lock(_settings_mtx);
+    return setting->valid && setting->value == value;
+}
+
+bool chameleon_isrp_impl::read_cached(const setting_t *setting, double &value) const {
+    if (setting == nullptr) {
+        return false;
+    }
+    std::lock_guard<std::mutex> const lock(_settings_mtx);
+    if (!setting->valid || setting->refresh == REFRESH_ALWAYS) {
+        return false;
+    }
+    value = setting->value;
+    return true;
+}
+
+void chameleon_isrp_impl::update_cached(setting_t *setting, const double value, const bool ok) const {
+    if (setting == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> const lock(_settings_mtx);
+    // A set that failed may still have reached the firmware, so its value is unknown
+    setting->valid = ok;
+    setting->value = value;
+}
+
+void chameleon_isrp_impl::create_tree() {
+    _tree = uhd::property_tree::make();
+    const uhd::fs_path mb_path = "/mboards/0";
+
+    _tree->create<uhd::time_spec_t>(mb_path / "time" / "now")
+            .set_publisher([this] { return get_time_now(0); })
+            .add_desired_subscriber([this](const uhd::time_spec_t &time) { set_time_now(time, 0); });
+
+    for (size_t chan = 1; chan <= ipsolon_rx_stream::MAX_RX_CHANNELS; chan++) {
+        const uhd::fs_path chan_path = mb_path / "channels" / chan;
+        _tree->create<double>(chan_path / "freq" / "value")
+                .set_publisher([this, chan] { return get_freq(chan); })
+                .add_desired_subscriber([this, chan](const double freq) {
+                    uhd::tune_request_t tune_request{};
+                    tune_request.rf_freq = freq;
+                    set_freq(tune_request, chan);
+                });
+        _tree->create<double>(chan_path / "rx_gain" / "value")
+                .set_publisher([this, chan] { return get_rx_gain("", chan); })
+                .add_desired_subscriber([this, chan](const double gain) { set_rx_gain(gain, "", chan); });
+        _tree->create<double>(chan_path / "tx_gain" / "value")
+                .set_publisher([this, chan] { return get_tx_gain("", chan); })
+                .add_desired_subscriber([this, chan](const double gain) { set_tx_gain(gain, "", chan); });
+    }
 }
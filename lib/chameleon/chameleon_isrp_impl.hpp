@@ -6,12 +6,23 @@
 #ifndef CHAMELEON_ISRP_IMPL_HPP
 #define CHAMELEON_ISRP_IMPL_HPP
 
+#include <mutex>
+
 #include "chameleon_fw_commander.hpp"
 #include "ipsolon_isrp.hpp"
+#include "ipsolon_rx_stream.hpp"
 #include "chameleon_device.hpp"
 
 namespace ihd {
 
+/*!
+ * The settings of the channels are cached on the host: every ACKed set and every read updates the cache,
+ * reads of a cached setting don't go to the firmware and sets to the value it already has are skipped.
+ * So only this host may change them, another client's changes are not seen.
+ * A tune asking for a calibration (cal_mask not 0, as with DEFAULT_CAL) is never skipped, it re-calibrates.
+ *
+ * get_tree() has the settings under /mboards/0, a get or set there is a get_* or set_* call.
+ */
 class chameleon_isrp_impl : public ipsolon_isrp
 {
 
@@ -34,15 +45,66 @@ public:
     void                   set_time_now(const uhd::time_spec_t& time_spec, size_t mboard) override;
     uhd::time_spec_t       get_time_now(size_t mboard) override;
 
+    /*! The nodes call back into this object, don't use the tree after it is destroyed */
+    uhd::property_tree::sptr get_tree() const override;
+
     int get_temperatures(temperature_t &temperatures, size_t timeout) override;
 
     int stream_stop_all() override;
 
+    int set_rx_configs(const std::vector<rx_config_t> &configs, size_t timeout) override;
+
 private:
+    static constexpr uint32_t INTERNAL_PATH_DELAY_CAL = 0x200;
+    static constexpr uint32_t LOOPBACK_LO_DELAY_CAL = 0x2000;
+    static constexpr uint32_t QEC_CAL = 0x1000;
+    static constexpr uint32_t DEFAULT_CAL = QEC_CAL | LOOPBACK_LO_DELAY_CAL | INTERNAL_PATH_DELAY_CAL;
+
+    /*! When a read of a setting goes to the firmware */
+    typedef enum refresh {
+        REFRESH_ALWAYS, /* Every read */
+        REFRESH_ON_SET  /* Only while nothing is cached */
+    } refresh_t;
+
+    static constexpr refresh_t FREQ_REFRESH = REFRESH_ON_SET;
+    static constexpr refresh_t GAIN_REFRESH = REFRESH_ON_SET;
+
+    /*! The value the firmware last ACKed or returned for a setting */
+    typedef struct setting {
+        refresh_t refresh;
+        bool valid;
+        double value;
+    } setting_t;
+
+    typedef struct channel_settings {
+        setting_t freq;
+        setting_t rx_gain;
+        setting_t tx_gain;
+    } channel_settings_t;
+
     uhd::tune_result_t     set_freq(const uhd::tune_request_t& tune_request, size_t chan) const;
     double                 get_freq( size_t chan)const;
+
+    /*! A cached setting of chan, nullptr for a channel that is not cached */
+    setting_t *get_setting(size_t chan, setting_t channel_settings_t::*setting) const;
+
+    /*! Whether the firmware is known to have value, false if setting is nullptr */
+    bool is_current(const setting_t *setting, double value) const;
+
+    /*! Read a setting from the cache if its refresh policy allows, false if the firmware must be asked */
+    bool read_cached(const setting_t *setting, double &value) const;
+
+    /*! Record what the firmware ACKed or returned, or forget the value if ok is false */
+    void update_cached(setting_t *setting, double value, bool ok) const;
+
+    void create_tree();
+
     uhd::device::sptr _dev;
-    chameleon_fw_commander _commander;
+    chameleon_fw_commander::sptr _commander;
+
+    mutable std::mutex _settings_mtx;
+    mutable channel_settings_t _channel_settings[ipsolon_rx_stream::MAX_RX_CHANNELS]; /* Channels indexed at 1 */
+    uhd::property_tree::sptr _tree;
 };
 
 }
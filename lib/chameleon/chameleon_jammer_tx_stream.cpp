@@ -2,7 +2,10 @@
 // Created by jmeyers on 11/6/24.
 //
 
+#include <cstring>
+
 #include "chameleon_jammer_tx_stream.hpp"
+#include <exception.hpp>
 
 ihd::chameleon_jammer_tx_stream::chameleon_jammer_tx_stream(const uhd::stream_args_t &stream_cmd,
                                                             const uhd::device_addr_t &device_addr) {
@@ -23,7 +26,18 @@ ihd::chameleon_jammer_tx_stream::chameleon_jammer_tx_stream(const uhd::stream_ar
             port = std::to_string(JAMMER_PORT_TX1);
             break;
     }
-    _udp_cmd_port = uhd::transport::udp_simple::make_connected(device_addr["addr"], port);
+    // Commands are sent one at a time, a single frame is all the link needs
+    transport::link_params_t default_params;
+    default_params.send_frame_size = transport::MAX_ETHERNET_MTU;
+    default_params.num_send_frames = transport::UDP_DEFAULT_NUM_FRAMES;
+    default_params.send_buff_size = JAMMER_SEND_BUFF_SIZE;
+    transport::link_params_t params = transport::calculate_udp_link_params(
+        transport::link_type_t::TX_DATA, transport::MAX_ETHERNET_MTU, 0, default_params, device_addr, stream_cmd.args);
+    // The device's recv_* args are meant for the rx streams, the jammer never receives
+    params.num_recv_frames = 0;
+    params.recv_frame_size = 0;
+    params.recv_buff_size = 0;
+    _udp_cmd_port = chameleon_udp_link::make(device_addr["addr"], port, params);
 }
 
 size_t ihd::chameleon_jammer_tx_stream::get_num_channels() const {
@@ -37,9 +51,17 @@ size_t ihd::chameleon_jammer_tx_stream::get_max_num_samps() const {
 size_t ihd::chameleon_jammer_tx_stream::send(const uhd::tx_streamer::buffs_type &buffs, const size_t nsamps_per_buff,
                                              const uhd::tx_metadata_t &metadata, const double timeout) {
     size_t s = nsamps_per_buff * sizeof(uint32_t);
-    auto *v = (std::vector<uint32_t> *) buffs[0];
-    size_t ret = _udp_cmd_port->send(boost::asio::buffer(v, s));
-    return ret;
+    if (s > _udp_cmd_port->get_send_frame_size()) {
+        THROW_VALUE_NOT_SUPPORTED_ERROR(std::to_string(nsamps_per_buff));
+    }
+    transport::frame_buff::uptr buff = _udp_cmd_port->get_send_buff(static_cast<int32_t>(timeout * 1000));
+    if (!buff) {
+        return 0;
+    }
+    memcpy(buff->data(), buffs[0], s);
+    buff->set_packet_size(s);
+    _udp_cmd_port->release_send_buff(std::move(buff));
+    return s;
 }
 
 bool ihd::chameleon_jammer_tx_stream::recv_async_msg(uhd::async_metadata_t &async_metadata, double timeout) {
@@ -5,8 +5,8 @@
 #ifndef CHAMELEON_JAMMER_TX_STREAMER_HPP
 #define CHAMELEON_JAMMER_TX_STREAMER_HPP
 
-#include <uhd/transport/udp_simple.hpp>
 #include "ipsolon_tx_stream.hpp"
+#include "chameleon_udp_link.hpp"
 
 namespace ihd {
 
@@ -30,7 +30,8 @@ private:
     static constexpr uint32_t JAMMER_PORT_TX2 = JAMMER_PORT_TX1 + 1;
     static constexpr uint32_t JAMMER_PORT_TX3 = JAMMER_PORT_TX2 + 1;
     static constexpr uint32_t JAMMER_PORT_TX4 = JAMMER_PORT_TX3 + 1;
-    uhd::transport::udp_simple::sptr _udp_cmd_port{};
+    static constexpr size_t JAMMER_SEND_BUFF_SIZE = 64 * 1024;
+    chameleon_udp_link::sptr _udp_cmd_port{};
 };
 
 }
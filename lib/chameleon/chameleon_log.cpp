@@ -0,0 +1,106 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <chrono>
+#include <cstdio>
+
+#include "chameleon_log.hpp"
+
+using namespace ihd;
+
+chameleon_log &chameleon_log::instance() {
+    static chameleon_log log;
+    return log;
+}
+
+chameleon_log::chameleon_log() : _records(RING_SIZE) {
+    for (size_t i = 0; i < RING_SIZE; i++) {
+        _records[i].seq.store(i, std::memory_order_relaxed);
+    }
+    _thread = std::thread([this] { drain_thread_func(); });
+}
+
+chameleon_log::~chameleon_log() {
+    _run = false;
+    _thread.join();
+    drain();
+}
+
+void chameleon_log::write(site_t &site, const char *fmt, ...) {
+    const uint64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    uint64_t start_ns = site.window_start_ns.load(std::memory_order_relaxed);
+    if (now_ns - start_ns >= SITE_INTERVAL_MS * 1000000 &&
+        site.window_start_ns.compare_exchange_strong(start_ns, now_ns, std::memory_order_relaxed)) {
+        site.count.store(0, std::memory_order_relaxed);
+    }
+    if (site.count.fetch_add(1, std::memory_order_relaxed) >= SITE_BURST) {
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const uint32_t suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+    va_list args;
+    va_start(args, fmt);
+    if (!instance().push(suppressed, fmt, args)) {
+        instance()._lost.fetch_add(1, std::memory_order_relaxed);
+        site.suppressed.fetch_add(suppressed, std::memory_order_relaxed); // Report them with the next one
+    }
+    va_end(args);
+}
+
+bool chameleon_log::push(const uint32_t suppressed, const char *fmt, va_list args) {
+    size_t pos = _tail.load(std::memory_order_relaxed);
+    record_t *rec;
+    for (;;) {
+        rec = &_records[pos & (RING_SIZE - 1)];
+        const size_t seq = rec->seq.load(std::memory_order_acquire);
+        const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false; // Full, the drain thread has not printed this record yet
+        } else {
+            pos = _tail.load(std::memory_order_relaxed); // Another thread claimed it
+        }
+    }
+    rec->suppressed = suppressed;
+    const int len = vsnprintf(rec->text, TEXT_SIZE, fmt, args);
+    if (len > 0 && static_cast<size_t>(len) < TEXT_SIZE && rec->text[len - 1] == '\n') {
+        rec->text[len - 1] = '\0'; // The drain thread ends every line
+    }
+    rec->seq.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+void chameleon_log::drain_thread_func() {
+    while (_run) {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_POLL_MS));
+    }
+}
+
+void chameleon_log::drain() {
+    for (;;) {
+        record_t &rec = _records[_head & (RING_SIZE - 1)];
+        if (rec.seq.load(std::memory_order_acquire) != _head + 1) {
+            break; // Not written yet
+        }
+        if (rec.suppressed > 0) {
+            fprintf(stderr, "%s [%u similar messages suppressed]\n", rec.text, rec.suppressed);
+        } else {
+            fprintf(stderr, "%s\n", rec.text);
+        }
+        rec.seq.store(_head + RING_SIZE, std::memory_order_release);
+        _head++;
+    }
+    const uint64_t lost = _lost.exchange(0, std::memory_order_relaxed);
+    if (lost > 0) {
+        fprintf(stderr, "chameleon_log: %lu messages lost, the log ring was full\n", lost);
+    }
+}
@@ -0,0 +1,87 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_LOG_HPP
+#define CHAMELEON_LOG_HPP
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/*!
+ * printf to stderr for the receive paths, rate limited per call site.
+ * Formats into a lock-free ring and returns, a background thread does the writing.
+ * Unlike dbprintf it is not compiled out by NDEBUG.
+ */
+#define rlprintf(fmt, ...) \
+do { static ihd::chameleon_log::site_t _rl_site; \
+     ihd::chameleon_log::write(_rl_site, "%s:%d:%s: " fmt, __FILE__, __LINE__, __func__, ##__VA_ARGS__); } while (0)
+
+namespace ihd {
+    /*!
+     * Process wide log for threads that must not block on stderr.
+     *
+     * write() claims a record of a bounded multi-producer ring with a compare-and-swap, formats the message
+     * into it and publishes it, it never takes a lock or makes a system call. When the ring is full the
+     * message is counted as lost. A drain thread, started by the first write(), prints the records in order.
+     *
+     * Each call site lets SITE_BURST messages through per SITE_INTERVAL_MS, the next message it prints after
+     * that says how many were suppressed.
+     */
+    class chameleon_log {
+    public:
+        static constexpr size_t RING_SIZE = 1024; /* Records, a power of 2 */
+        static constexpr size_t TEXT_SIZE = 240;
+        static constexpr uint32_t SITE_BURST = 5;
+        static constexpr uint64_t SITE_INTERVAL_MS = 1000;
+        static constexpr int DRAIN_POLL_MS = 20;
+
+        /*! Rate limit state of one call site, a static of the rlprintf() expansion */
+        typedef struct site {
+            std::atomic<uint64_t> window_start_ns{0};
+            std::atomic<uint32_t> count{0};     /* Messages in the current window */
+            std::atomic<uint32_t> suppressed{0}; /* Messages dropped since the last one printed */
+        } site_t;
+
+        /*! Log a message from site, see rlprintf() */
+        static void write(site_t &site, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+        chameleon_log(const chameleon_log &) = delete;
+        chameleon_log &operator=(const chameleon_log &) = delete;
+
+    private:
+        typedef struct record {
+            std::atomic<size_t> seq; /* Ring position the record is free for, or that position + 1 once written */
+            uint32_t suppressed;
+            char text[TEXT_SIZE];
+        } record_t;
+
+        chameleon_log();
+
+        ~chameleon_log();
+
+        static chameleon_log &instance();
+
+        /*! Format into a free record, false if the ring is full */
+        bool push(uint32_t suppressed, const char *fmt, va_list args);
+
+        void drain_thread_func();
+
+        /*! Print the published records, drain thread only */
+        void drain();
+
+        std::vector<record_t> _records;
+        alignas(64) std::atomic<size_t> _tail{0}; /* Next position to claim */
+        alignas(64) size_t _head{0};              /* Next position to print, drain thread only */
+        std::atomic<uint64_t> _lost{0};           /* Messages that found the ring full */
+        std::atomic<bool> _run{true};
+        std::thread _thread;
+    };
+} // ihd
+
+#endif //CHAMELEON_LOG_HPP
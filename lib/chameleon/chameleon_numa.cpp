@@ -0,0 +1,104 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <ifaddrs.h>
+#include <linux/mempolicy.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "chameleon_numa.hpp"
+#include "debug.hpp"
+
+using namespace ihd;
+
+static constexpr size_t MAX_NUMA_NODES = 1024;
+
+/* First line of a sysfs file, empty if it can't be read */
+static std::string read_sysfs_line(const std::string &path) {
+    std::string line;
+    FILE *f = fopen(path.c_str(), "r");
+    if (f != nullptr) {
+        char buf[4096];
+        if (fgets(buf, sizeof(buf), f) != nullptr) {
+            line.assign(buf, strcspn(buf, "\n"));
+        }
+        fclose(f);
+    }
+    return line;
+}
+
+int chameleon_numa::get_interface_node(const in_addr_t ip) {
+    int node = NO_NODE;
+    ifaddrs *ifas = nullptr;
+    if (ip == INADDR_ANY || getifaddrs(&ifas) != 0) {
+        return NO_NODE;
+    }
+    for (ifaddrs *ifa = ifas; ifa != nullptr; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr != nullptr && ifa->ifa_addr->sa_family == AF_INET &&
+            reinterpret_cast<const sockaddr_in *>(ifa->ifa_addr)->sin_addr.s_addr == ip) {
+            // Virtual devices have no device link, a single node machine reports -1
+            std::string node_str = read_sysfs_line(std::string("/sys/class/net/") + ifa->ifa_name +
+                                                   "/device/numa_node");
+            if (!node_str.empty()) {
+                node = static_cast<int>(strtol(node_str.c_str(), nullptr, 10));
+            }
+            dbprintf("VITA interface %s NUMA node %d\n", ifa->ifa_name, node);
+            break;
+        }
+    }
+    freeifaddrs(ifas);
+    return (node >= 0) ? node : NO_NODE;
+}
+
+bool chameleon_numa::get_node_cpus(const int node, cpu_set_t &cpus) {
+    CPU_ZERO(&cpus);
+    if (node < 0) {
+        return false;
+    }
+    // A list of ranges: "0-7,16-23"
+    std::string list = read_sysfs_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    const char *p = list.c_str();
+    while (*p != '\0') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(static_cast<int>(cpu), &cpus);
+        }
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return CPU_COUNT(&cpus) > 0;
+}
+
+bool chameleon_numa::bind_memory(void *mem, const size_t len, const int node) {
+    if (node < 0 || static_cast<size_t>(node) >= MAX_NUMA_NODES) {
+        return false;
+    }
+    unsigned long nodemask[MAX_NUMA_NODES / (sizeof(unsigned long) * CHAR_BIT)] = {};
+    nodemask[node / (sizeof(unsigned long) * CHAR_BIT)] = 1UL << (node % (sizeof(unsigned long) * CHAR_BIT));
+    long err = syscall(__NR_mbind, mem, len, MPOL_PREFERRED, nodemask, MAX_NUMA_NODES, MPOL_MF_MOVE);
+    if (err != 0) {
+        perror("mbind of the packet pool failed");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_NUMA_HPP
+#define CHAMELEON_NUMA_HPP
+#include <cstddef>
+#include <netinet/in.h>
+#include <sched.h>
+
+namespace ihd {
+    /*!
+     * NUMA topology from sysfs and memory placement with mbind(2), without a libnuma dependency.
+     * Every function treats a node of -1 as "no NUMA information" and fails soft on a non NUMA kernel.
+     */
+    class chameleon_numa {
+    public:
+        static constexpr int NO_NODE = -1;
+
+        /*!
+         * NUMA node of the network device that owns a local IPv4 address
+         * \return the node, NO_NODE for INADDR_ANY, a non local address or a device without one (e.g. lo)
+         */
+        static int get_interface_node(in_addr_t ip);
+
+        /*!
+         * The CPUs of a node, from /sys/devices/system/node/node<node>/cpulist
+         * \return false if the node does not exist
+         */
+        static bool get_node_cpus(int node, cpu_set_t &cpus);
+
+        /*!
+         * Ask for the pages of [mem, mem + len) to come from node. Must be called before the pages are
+         * touched, pages that are already there are moved when the kernel can.
+         * The policy is MPOL_PREFERRED: a node that runs out of memory falls back to the others
+         * rather than failing the fault.
+         * \return false if the kernel refused the policy
+         */
+        static bool bind_memory(void *mem, size_t len, int node);
+    };
+} // ihd
+
+#endif //CHAMELEON_NUMA_HPP
@@ -10,13 +10,15 @@
 
 using namespace ihd;
 
-chameleon_packet::chameleon_packet(size_t maximum_packet_size) :_packet_size(maximum_packet_size),
+chameleon_packet::chameleon_packet(size_t maximum_packet_size) :_buffer_size(maximum_packet_size),
+                                                                _packet_size(maximum_packet_size),
                                                                 _data_size(maximum_packet_size - ipsolon_rx_stream::PACKET_HEADER_SIZE),
                                                                 _nIQ_pairs(_data_size / ipsolon_rx_stream::BYTES_PER_IQ_PAIR),
                                                                 _pos(0),
-                                                                _samples(nullptr)
+                                                                _samples(nullptr),
+                                                                _owns_mem(true)
 {
-    _packet_mem = static_cast<uint8_t *>(malloc(_packet_size));
+    _packet_mem = static_cast<uint8_t *>(malloc(_buffer_size));
     if(_packet_mem == nullptr) {
         THROW_MALLOC_ERROR();
     } else {
@@ -24,9 +26,20 @@ chameleon_packet::chameleon_packet(size_t maximum_packet_size) :_packet_size(max
     }
 }
 
+chameleon_packet::chameleon_packet(uint8_t *packet_mem, size_t maximum_packet_size) :_buffer_size(maximum_packet_size),
+                                                                _packet_size(maximum_packet_size),
+                                                                _data_size(maximum_packet_size - ipsolon_rx_stream::PACKET_HEADER_SIZE),
+                                                                _nIQ_pairs(_data_size / ipsolon_rx_stream::BYTES_PER_IQ_PAIR),
+                                                                _pos(0),
+                                                                _packet_mem(packet_mem),
+                                                                _samples(reinterpret_cast<int16_t *>(packet_mem + ipsolon_rx_stream::PACKET_HEADER_SIZE)),
+                                                                _owns_mem(false)
+{
+}
+
 chameleon_packet::~chameleon_packet()
 {
-    if (_packet_mem != nullptr) {
+    if (_owns_mem && _packet_mem != nullptr) {
         free(_packet_mem);
     }
 }
@@ -55,14 +68,16 @@ uint64_t chameleon_packet::getTimestamp() const
     if(_packet_mem == nullptr) {
         return 0;
     } else {
-        return static_cast<uint64_t>(_packet_mem[0]) |
-               static_cast<uint64_t>(_packet_mem[1]) << 8 |
-               static_cast<uint64_t>(_packet_mem[2]) << 16 |
-               static_cast<uint64_t>(_packet_mem[3]) << 24 |
-               static_cast<uint64_t>(_packet_mem[4]) << 32 |
-               static_cast<uint64_t>(_packet_mem[5]) << 40 |
-               static_cast<uint64_t>(_packet_mem[6]) << 48 |
-               static_cast<uint64_t>(_packet_mem[7]) << 56;;
+        // The timestamp follows the CHDR header
+        const uint8_t *ts = _packet_mem + chdr_header::CHDR_W;
+        return static_cast<uint64_t>(ts[0]) |
+               static_cast<uint64_t>(ts[1]) << 8 |
+               static_cast<uint64_t>(ts[2]) << 16 |
+               static_cast<uint64_t>(ts[3]) << 24 |
+               static_cast<uint64_t>(ts[4]) << 32 |
+               static_cast<uint64_t>(ts[5]) << 40 |
+               static_cast<uint64_t>(ts[6]) << 48 |
+               static_cast<uint64_t>(ts[7]) << 56;
     }
 }
 
@@ -72,6 +87,23 @@ size_t chameleon_packet::getPacketSize() const
     return _packet_size;
 }
 
+[[nodiscard]]
+size_t chameleon_packet::getBufferSize() const
+{
+    return _buffer_size;
+}
+
+[[nodiscard]]
+uint32_t chameleon_packet::getSource() const
+{
+    return _source;
+}
+
+void chameleon_packet::setSource(uint32_t source)
+{
+    _source = source;
+}
+
 void chameleon_packet::setPacketSize(size_t packetSize)
 {
     _packet_size = packetSize;
@@ -91,6 +123,21 @@ size_t chameleon_packet::getPos() const
     return _pos;
 }
 
+size_t chameleon_packet::getSamplesLeft() const
+{
+    return (_pos < _nIQ_pairs) ? (_nIQ_pairs - _pos) : 0;
+}
+
+size_t chameleon_packet::getNumSamples() const
+{
+    return _nIQ_pairs;
+}
+
+const int16_t *chameleon_packet::getSampleMem() const
+{
+    return _samples;
+}
+
 void chameleon_packet::setPos(size_t position)
 {
     _pos = std::min(position, _data_size - 1);
@@ -101,17 +148,20 @@ void chameleon_packet::rewind()
     setPos(0);
 }
 
-size_t chameleon_packet::getSamples(chameleon_rx_stream::chameleon_data_type *buff, size_t n_samples)
+size_t chameleon_packet::getSamples(void *buff, size_t n_samples, const chameleon_converter &convert)
 {
-    size_t n = std::min(n_samples, _nIQ_pairs - _pos);
-    for (size_t i = 0; i < n; i++) {
-        size_t s = (i * 2);
-        buff[i] = chameleon_rx_stream::chameleon_data_type(_samples[s], _samples[s + 1]);
-    }
+    size_t n = std::min(n_samples, getSamplesLeft());
+    convert(_samples + (_pos * 2), buff, n);
     _pos += n; // Move position in packet
     return n;
 }
 
+transport::frame_buff::uptr chameleon_packet::getFrameBuff()
+{
+    _frame.set(_samples, _nIQ_pairs * ipsolon_rx_stream::BYTES_PER_IQ_PAIR);
+    return transport::frame_buff::uptr(&_frame);
+}
+
 [[nodiscard]]
 bool chameleon_packet::endOfPacket() const
 {
@@ -9,35 +9,79 @@
 #include <cstdlib>
 
 #include "chameleon_rx_stream.hpp"
+#include "chameleon_converter.hpp"
+#include "transport/frame_buff.hpp"
 
 namespace ihd {
 
+class chameleon_packet;
+
+/*!
+ * frame_buff view of a chameleon_packet payload, handed out by the zero-copy receive path.
+ * data() points at the first IQ pair in the packet buffer, packet_size() is the payload size in bytes.
+ */
+class chameleon_frame_buff : public transport::frame_buff {
+public:
+    explicit chameleon_frame_buff(chameleon_packet *packet) : _packet(packet) {}
+
+    void set(void *data, size_t size) {
+        _data = data;
+        _packet_size = size;
+    }
+
+    [[nodiscard]] chameleon_packet *get_packet() const { return _packet; }
+
+private:
+    chameleon_packet *_packet;
+};
+
 class chameleon_packet {
 public:
     explicit chameleon_packet(size_t maximum_packet_size);
+    /*! Wrap caller owned packet memory, e.g. a slot in a chameleon_packet_pool slab */
+    chameleon_packet(uint8_t *packet_mem, size_t maximum_packet_size);
     ~chameleon_packet();
 
     [[nodiscard]] bool endOfPacket() const;
     [[nodiscard]] uint64_t getTimestamp() const;
     [[nodiscard]] uint8_t *getPacketMem() const;
     [[nodiscard]] size_t getPacketSize() const;
+    [[nodiscard]] size_t getBufferSize() const;
     [[nodiscard]] size_t getDataSize() const;
     [[nodiscard]] size_t getPos() const;
+    [[nodiscard]] size_t getSamplesLeft() const;
+    [[nodiscard]] size_t getNumSamples() const;
+    /*! The sc16 payload, getNumSamples() IQ pairs */
+    [[nodiscard]] const int16_t *getSampleMem() const;
     [[nodiscard]] chdr_header getCHDR() const;
+    /*! IPv4 address of the sender (network byte order), 0 if the receive backend does not report it */
+    [[nodiscard]] uint32_t getSource() const;
+
+    /*!
+     * Convert up to n_samples samples from the current position into buff and move past them
+     * \return the number of samples written
+     */
+    size_t getSamples(void *buff, size_t n_samples, const chameleon_converter &convert);
 
-    size_t getSamples(chameleon_rx_stream::chameleon_data_type *buff, size_t n_samples);
+    /*! Borrow the payload without copying it, the packet must not be reused until the frame is released */
+    transport::frame_buff::uptr getFrameBuff();
 
     void setPacketSize(size_t packetSize);
+    void setSource(uint32_t source);
     void setPos(size_t position);
     void rewind();
 
 private:
+    size_t _buffer_size; /* Capacity of _packet_mem, _packet_size is the size of the last packet received */
     size_t _packet_size;
     size_t _data_size;
     size_t _nIQ_pairs;
     size_t _pos;
     uint8_t *_packet_mem;
     int16_t *_samples;
+    bool _owns_mem;
+    uint32_t _source{};
+    chameleon_frame_buff _frame{this};
 
 };
 
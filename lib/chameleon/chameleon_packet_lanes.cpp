@@ -0,0 +1,335 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <uhd/exception.hpp>
+
+#include "chameleon_packet_lanes.hpp"
+#include "chameleon_packet.hpp"
+#include "chameleon_packet_pool.hpp"
+#include "chameleon_log.hpp"
+
+using namespace ihd;
+
+static constexpr size_t COLLECT_BATCH = 64;
+
+chameleon_packet_lanes::~chameleon_packet_lanes() {
+    if (_ready_fd >= 0) {
+        close(_ready_fd);
+    }
+}
+
+void chameleon_packet_lanes::reset(const chameleon_packet_pool *pool, size_t n_lanes, bool stealable) {
+    _pool = pool;
+    n_lanes = std::max<size_t>(n_lanes, 1);
+    _lanes.clear();
+    for (size_t i = 0; i < n_lanes; i++) {
+        lane_uptr l = make_aligned<lane_t>();
+        l->free_packets.reset(_pool->size());
+        // A lane owns pool size / n_lanes packets, so its rings are never full
+        l->sample_packets.reset(_pool->size(), stealable);
+        if (n_lanes > 1) {
+            l->sample_packets.set_doorbell(&_sample_doorbell);
+        }
+        _lanes.push_back(std::move(l));
+    }
+    for (size_t i = 0; i < _pool->size(); i++) {
+        _lanes[i % n_lanes]->free_packets.push(_pool->get(i));
+    }
+    _reorder.clear();
+    _ready.clear();
+    _held = 0;
+}
+
+chameleon_packet *chameleon_packet_lanes::pop() {
+    if (_lanes.size() == 1) {
+        chameleon_packet *cp = _lanes[0]->sample_packets.pop();
+        if (cp == nullptr) {
+            arm_ready();
+        }
+        return cp;
+    }
+    if (_ready.empty()) {
+        collect();
+        if (_ready.empty() && _held > 0) {
+            expire_gaps();
+        }
+    }
+    if (_ready.empty()) {
+        arm_ready();
+        return nullptr;
+    }
+    chameleon_packet *cp = _ready.front();
+    _ready.pop_front();
+    return cp;
+}
+
+chameleon_packet *chameleon_packet_lanes::pop_wait(uint64_t timeout_ms) {
+    if (timeout_ms == 0) {
+        return pop(); // Don't spin on the ring either
+    }
+    if (_lanes.size() == 1) {
+        chameleon_packet *cp = _lanes[0]->sample_packets.pop_wait(timeout_ms);
+        if (cp == nullptr) {
+            arm_ready();
+        }
+        return cp;
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (;;) {
+        chameleon_packet *cp = pop();
+        if (cp != nullptr) {
+            return cp;
+        }
+        const auto remaining = deadline - std::chrono::steady_clock::now();
+        if (remaining.count() <= 0) {
+            return nullptr; // Timeout
+        }
+        auto remaining_ms = std::chrono::duration_cast<std::chrono::milliseconds>(remaining);
+        if (remaining_ms < remaining) {
+            remaining_ms += std::chrono::milliseconds(1); // Round up, don't wake before the deadline
+        }
+        auto wait_ms = static_cast<uint64_t>(remaining_ms.count());
+        if (_held > 0) {
+            // Come back in time to skip the gap the held packets are waiting on
+            wait_ms = std::min<uint64_t>(wait_ms, (REORDER_TIMEOUT_US + 999) / 1000);
+        }
+        _sample_doorbell.wait([this] { return samples_pending(); }, wait_ms);
+    }
+}
+
+int chameleon_packet_lanes::get_ready_fd() {
+    if (_ready_fd < 0) {
+        _ready_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (_ready_fd < 0) {
+            perror("ready eventfd creation failed");
+            throw uhd::runtime_error("ready eventfd creation failed");
+        }
+        arm_ready();
+    }
+    return _ready_fd;
+}
+
+chameleon_packet_lanes::ready_waiter_t chameleon_packet_lanes::set_ready_waiter(ready_waiter_t waiter) {
+    {
+        std::lock_guard<std::mutex> lock(_waiter_mtx);
+        if (_ready_waiter) {
+            throw uhd::runtime_error("ready waiter already set");
+        }
+        _ready_waiter = std::move(waiter);
+    }
+    _waiter_armed.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in notify_ready(), as in arm_ready()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (packets_pending() && _waiter_armed.exchange(false)) {
+        return take_ready_waiter();
+    }
+    return ready_waiter_t();
+}
+
+chameleon_packet_lanes::ready_waiter_t chameleon_packet_lanes::cancel_ready_waiter() {
+    if (_waiter_armed.exchange(false)) {
+        return take_ready_waiter();
+    }
+    return ready_waiter_t();
+}
+
+chameleon_packet_lanes::ready_waiter_t chameleon_packet_lanes::take_ready_waiter() const {
+    std::lock_guard<std::mutex> lock(_waiter_mtx);
+    ready_waiter_t waiter;
+    std::swap(waiter, _ready_waiter);
+    return waiter;
+}
+
+void chameleon_packet_lanes::notify_ready() const {
+    // Pairs with the fence in arm_ready(): either the consumer sees the pushed packets or we see it armed
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_ready_armed.load(std::memory_order_relaxed) && _ready_armed.exchange(false)) {
+        uint64_t one = 1;
+        if (write(_ready_fd, &one, sizeof(one)) < 0) {
+            rlprintf("ready eventfd write failed: %s\n", strerror(errno));
+        }
+    }
+    if (_waiter_armed.load(std::memory_order_relaxed) && _waiter_armed.exchange(false)) {
+        ready_waiter_t waiter = take_ready_waiter();
+        waiter(true);
+    }
+}
+
+void chameleon_packet_lanes::arm_ready() {
+    if (_ready_fd < 0 || _ready_armed.load(std::memory_order_relaxed)) {
+        return; // Not asked for, or nothing was signaled since it was last cleared
+    }
+    uint64_t count;
+    if (read(_ready_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        rlprintf("ready eventfd read failed: %s\n", strerror(errno));
+    }
+    _ready_armed.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Packets pushed before the receive thread saw the fd armed, or held behind a gap until it expires
+    if (packets_pending() && _ready_armed.exchange(false)) {
+        uint64_t one = 1;
+        if (write(_ready_fd, &one, sizeof(one)) < 0) {
+            rlprintf("ready eventfd write failed: %s\n", strerror(errno));
+        }
+    }
+}
+
+void chameleon_packet_lanes::release(chameleon_packet *cp) {
+    _lanes[_pool->index_of(cp) % _lanes.size()]->free_packets.push(cp);
+}
+
+void chameleon_packet_lanes::wake() {
+    for (lane_uptr &l: _lanes) {
+        l->free_packets.wake();
+    }
+}
+
+size_t chameleon_packet_lanes::capacity() const {
+    return (_pool != nullptr) ? _pool->size() : 0;
+}
+
+void chameleon_packet_lanes::drain() {
+    for (lane_uptr &l: _lanes) {
+        chameleon_packet *cp;
+        while ((cp = l->sample_packets.pop()) != nullptr) {
+            release(cp);
+        }
+    }
+    for (auto &key_vc: _reorder) {
+        reorder_state_t &vc = key_vc.second;
+        for (chameleon_packet *&cp: vc.slots) {
+            if (cp != nullptr) {
+                release(cp);
+                cp = nullptr;
+            }
+        }
+        vc.synced = false;
+        vc.stalled = false;
+        vc.held = 0;
+    }
+    for (chameleon_packet *cp: _ready) {
+        release(cp);
+    }
+    _ready.clear();
+    _held = 0;
+}
+
+void chameleon_packet_lanes::collect() {
+    chameleon_packet *batch[COLLECT_BATCH];
+    for (lane_uptr &l: _lanes) {
+        size_t n = l->sample_packets.pop_bulk(batch, COLLECT_BATCH);
+        for (size_t i = 0; i < n; i++) {
+            insert(batch[i]);
+        }
+    }
+}
+
+void chameleon_packet_lanes::insert(chameleon_packet *cp) {
+    reorder_state_t &vc = _reorder[reorder_key(cp)];
+    const uint16_t seq = cp->getCHDR().get_seq_num();
+    if (!vc.synced) {
+        if (vc.slots.empty()) {
+            vc.slots.assign(REORDER_WINDOW, nullptr);
+        }
+        // Deliver from the first packet on without waiting, an older one still on another lane is dropped
+        vc.next_seq = seq;
+        vc.synced = true;
+    }
+
+    auto ahead = static_cast<int16_t>(seq - vc.next_seq);
+    if (ahead < 0) {
+        count_reorder();
+        release(cp); // Its gap has already been skipped (and counted as lost)
+        return;
+    }
+    while (ahead >= static_cast<int16_t>(REORDER_WINDOW) && vc.held > 0) {
+        // Too far ahead to wait for the gap any longer
+        skip_gap(vc);
+        ahead = static_cast<int16_t>(seq - vc.next_seq);
+    }
+    if (ahead >= static_cast<int16_t>(REORDER_WINDOW)) {
+        vc.next_seq = seq; // Nothing held, start over from here
+    }
+
+    chameleon_packet *&slot = vc.slots[seq & (REORDER_WINDOW - 1)];
+    if (slot != nullptr) {
+        release(cp); // Duplicate
+        return;
+    }
+    slot = cp;
+    vc.held++;
+    _held++;
+    if (seq == vc.next_seq) {
+        if (vc.held > 1) {
+            count_reorder(); // Filled a gap later packets were waiting on
+        }
+        deliver(vc);
+    } else if (!vc.stalled) {
+        vc.stalled = true;
+        vc.stalled_since = std::chrono::steady_clock::now();
+    }
+}
+
+void chameleon_packet_lanes::deliver(reorder_state_t &vc) {
+    chameleon_packet *cp;
+    while ((cp = vc.slots[vc.next_seq & (REORDER_WINDOW - 1)]) != nullptr) {
+        vc.slots[vc.next_seq & (REORDER_WINDOW - 1)] = nullptr;
+        _ready.push_back(cp);
+        vc.next_seq++;
+        vc.held--;
+        _held--;
+    }
+    // What is left waits on a new gap
+    vc.stalled = vc.held > 0;
+    if (vc.stalled) {
+        vc.stalled_since = std::chrono::steady_clock::now();
+    }
+}
+
+void chameleon_packet_lanes::skip_gap(reorder_state_t &vc) {
+    while (vc.slots[vc.next_seq & (REORDER_WINDOW - 1)] == nullptr) {
+        vc.next_seq++;
+    }
+    deliver(vc);
+}
+
+void chameleon_packet_lanes::expire_gaps() {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto &key_vc: _reorder) {
+        reorder_state_t &vc = key_vc.second;
+        if (vc.stalled && now - vc.stalled_since >= std::chrono::microseconds(REORDER_TIMEOUT_US)) {
+            skip_gap(vc);
+        }
+    }
+}
+
+uint64_t chameleon_packet_lanes::reorder_key(const chameleon_packet *cp) {
+    return (static_cast<uint64_t>(cp->getSource()) << 8) | cp->getCHDR().get_vc();
+}
+
+void chameleon_packet_lanes::count_reorder() {
+    _reorder_events.store(_reorder_events.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+bool chameleon_packet_lanes::packets_pending() const {
+    return !_ready.empty() || _held > 0 || samples_pending();
+}
+
+bool chameleon_packet_lanes::samples_pending() const {
+    for (const lane_uptr &l: _lanes) {
+        if (!l->sample_packets.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
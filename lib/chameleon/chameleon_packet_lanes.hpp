@@ -0,0 +1,198 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_PACKET_LANES_HPP
+#define CHAMELEON_PACKET_LANES_HPP
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "chameleon_packet_ring.hpp"
+
+namespace ihd {
+    class chameleon_packet;
+    class chameleon_packet_pool;
+
+    /*!
+     * The free and sample queues of a stream received by one or more receive threads.
+     *
+     * Every receive thread (lane) has its own pair of SPSC rings and its own share of the packet pool,
+     * packet i belongs to lane i % lanes, so a released packet always goes back to the thread it came from.
+     * With more than one lane the sockets share the VITA port and the datagrams are spread over the lanes,
+     * so the consumer side puts them back in CHDR sequence order (per sender and virtual channel) before handing
+     * them out. The first packet of a sender's channel starts its sequence, an older one arriving after it on
+     * another lane is dropped. A gap is waited for until REORDER_TIMEOUT_US has passed or the window fills up,
+     * then it is skipped and reported by the stream's sequence check like any other lost packet.
+     *
+     * With a single lane pop() is the sample ring's pop(), nothing is reordered.
+     *
+     * get_ready_fd() gives the consumer an eventfd to wait on in its own event loop instead of pop_wait().
+     * It is readable while packets may be waiting. Reading it is left to pop(): it is cleared (and re-armed)
+     * when pop() finds nothing. A receive thread writes it only for the first push after that, so a consumer
+     * that keeps up costs the receive threads one write() per wakeup, and a consumer that never asked for the
+     * fd costs them nothing. set_ready_waiter() does the same for a one-shot callback.
+     */
+    class chameleon_packet_lanes {
+    public:
+        static constexpr size_t REORDER_WINDOW = 256; /* Packets held per virtual channel, a power of 2 */
+        static constexpr uint64_t REORDER_TIMEOUT_US = 1000;
+
+        /*! Called once packets may be waiting (true), or when the wait is cancelled (false) */
+        typedef std::function<void(bool ready)> ready_waiter_t;
+
+        chameleon_packet_lanes() = default;
+
+        ~chameleon_packet_lanes();
+
+        chameleon_packet_lanes(const chameleon_packet_lanes &) = delete;
+        chameleon_packet_lanes &operator=(const chameleon_packet_lanes &) = delete;
+
+        /*!
+         * Split the pool into n_lanes lanes and put every packet on its lane's free ring. Not thread safe.
+         * \param stealable let the receive threads steal() back packets from their sample rings
+         */
+        void reset(const chameleon_packet_pool *pool, size_t n_lanes, bool stealable = false);
+
+        [[nodiscard]] size_t get_num_lanes() const { return _lanes.size(); }
+
+        /*! Receive thread of lane: takes free packets from here */
+        chameleon_packet_ring &get_free_ring(size_t lane) { return _lanes[lane]->free_packets; }
+
+        /*! Receive thread of lane: puts received packets here */
+        chameleon_packet_ring &get_sample_ring(size_t lane) { return _lanes[lane]->sample_packets; }
+
+        /*!
+         * Consumer: next received packet without waiting
+         * \return nullptr when there is none (or the next one is held back by a gap)
+         */
+        chameleon_packet *pop();
+
+        /*!
+         * Consumer: next received packet, waiting up to timeout_ms. A timeout of 0 is pop().
+         * \return nullptr on timeout
+         */
+        chameleon_packet *pop_wait(uint64_t timeout_ms);
+
+        /*!
+         * Consumer: eventfd that is readable when pop() may return a packet, created on the first call.
+         * Spurious wakeups are possible, pop() until it returns nullptr to re-arm it.
+         * \throws uhd::runtime_error if the eventfd can't be created
+         */
+        int get_ready_fd();
+
+        /*!
+         * Consumer: call waiter on the receive thread that next pushes a packet. One waiter at a time.
+         * \return waiter when packets may already be waiting, for the caller to call, empty otherwise
+         * \throws uhd::runtime_error if a waiter is already set
+         */
+        ready_waiter_t set_ready_waiter(ready_waiter_t waiter);
+
+        /*!
+         * Take back the waiter before it was called, to call it with false
+         * \return empty if there is none, or it is being called
+         */
+        ready_waiter_t cancel_ready_waiter();
+
+        /*!
+         * Receive thread: called after pushing to a sample ring, signals the ready fd and calls the
+         * ready waiter if they are armed
+         */
+        void notify_ready() const;
+
+        /*!
+         * Consumer: give a packet back to the free ring of its lane
+         */
+        void release(chameleon_packet *cp);
+
+        /*!
+         * Wake the receive threads waiting for free packets so they can re-check their run state
+         */
+        void wake();
+
+        /*! Packets in the pool */
+        [[nodiscard]] size_t capacity() const;
+
+        /*! Packets that arrived after a later one of their virtual channel, safe from any thread */
+        [[nodiscard]] uint64_t get_reorder_events() const { return _reorder_events.load(std::memory_order_relaxed); }
+
+        /*!
+         * Return every received and held packet to the free rings and forget the sequence state.
+         * Only when the receive threads are stopped: the caller acts as producer of the free rings.
+         */
+        void drain();
+
+    private:
+        typedef struct lane {
+            chameleon_packet_ring free_packets;
+            chameleon_packet_ring sample_packets;
+        } lane_t;
+        typedef std::unique_ptr<lane_t, aligned_delete<lane_t>> lane_uptr;
+
+        /* Reorder window of one sender's CHDR virtual channel, packet seq waits in slots[seq % REORDER_WINDOW] */
+        typedef struct reorder_state {
+            std::vector<chameleon_packet *> slots;
+            uint16_t next_seq{};
+            bool synced{}; /* next_seq is valid */
+            size_t held{};
+            std::chrono::steady_clock::time_point stalled_since;
+            bool stalled{}; /* Packets are held behind a gap since stalled_since */
+        } reorder_state_t;
+
+        const chameleon_packet_pool *_pool{};
+        std::vector<lane_uptr> _lanes;
+        chameleon_ring_doorbell _sample_doorbell; /* Rung by every lane's sample ring */
+
+        std::unordered_map<uint64_t, reorder_state_t> _reorder; /* By reorder_key() */
+        std::deque<chameleon_packet *> _ready; /* In order, ready to be popped */
+        size_t _held{}; /* Packets in all reorder windows */
+        std::atomic<uint64_t> _reorder_events{0}; /* Written by the consumer only */
+
+        int _ready_fd{-1}; /* get_ready_fd(), -1 until asked for */
+        mutable std::atomic<bool> _ready_armed{false}; /* The next notify_ready() signals _ready_fd */
+        mutable std::mutex _waiter_mtx;
+        mutable ready_waiter_t _ready_waiter;
+        mutable std::atomic<bool> _waiter_armed{false}; /* The next notify_ready() calls _ready_waiter */
+
+        /*! Move everything the receive threads have pushed into the reorder windows */
+        void collect();
+
+        void insert(chameleon_packet *cp);
+
+        /*! Sender address and CHDR virtual channel, two radios streaming to the same port keep apart */
+        static uint64_t reorder_key(const chameleon_packet *cp);
+
+        void count_reorder();
+
+        /*! Move the packets in sequence at the start of vc's window to _ready */
+        void deliver(reorder_state_t &vc);
+
+        /*! Skip the gap at the start of vc's window */
+        void skip_gap(reorder_state_t &vc);
+
+        /*! Skip the gaps that have been waited for long enough */
+        void expire_gaps();
+
+        [[nodiscard]] bool samples_pending() const;
+
+        /*! Clear and re-arm the ready fd after pop() found nothing, unless it already is armed */
+        void arm_ready();
+
+        /*! Packets pop() may return now or once a reorder gap expires */
+        [[nodiscard]] bool packets_pending() const;
+
+        /*! Take the waiter after winning _waiter_armed */
+        ready_waiter_t take_ready_waiter() const;
+    };
+} // ihd
+
+#endif //CHAMELEON_PACKET_LANES_HPP
@@ -0,0 +1,90 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "chameleon_packet_pool.hpp"
+#include "chameleon_packet.hpp"
+#include "chameleon_numa.hpp"
+#include <exception.hpp>
+#include "debug.hpp"
+
+using namespace ihd;
+
+static inline size_t round_up(size_t n, size_t align) {
+    return ((n + align - 1) / align) * align;
+}
+
+chameleon_packet_pool::chameleon_packet_pool(size_t packet_cnt, size_t bytes_per_packet, bool huge_pages,
+                                             int numa_node, size_t headroom) :
+    _packet_cnt(packet_cnt),
+    _headroom(round_up(headroom, CACHE_LINE_SIZE)),
+    _buffer_stride(_headroom + round_up(bytes_per_packet, CACHE_LINE_SIZE)) {
+    const size_t descriptor_size = round_up(packet_cnt * sizeof(chameleon_packet), CACHE_LINE_SIZE);
+    const size_t slab_size = descriptor_size + (packet_cnt * _buffer_stride);
+
+    if (huge_pages) {
+        _mem_size = round_up(slab_size, HUGE_PAGE_SIZE);
+        _mem = mmap(nullptr, _mem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (_mem == MAP_FAILED) {
+            // No (or not enough) pages in /proc/sys/vm/nr_hugepages
+            dbfprintf(stderr, "MAP_HUGETLB of %zu bytes failed, using regular pages\n", _mem_size);
+            _mem = nullptr;
+        } else {
+            _huge = true;
+        }
+    }
+    if (_mem == nullptr) {
+        _mem_size = round_up(slab_size, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+        _mem = mmap(nullptr, _mem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (_mem == MAP_FAILED) {
+            _mem = nullptr;
+            THROW_MALLOC_ERROR();
+        }
+        if (huge_pages) {
+            madvise(_mem, _mem_size, MADV_HUGEPAGE);
+        }
+    }
+
+    // Nothing has been touched yet, so every page faults in on the node
+    if (numa_node >= 0 && chameleon_numa::bind_memory(_mem, _mem_size, numa_node)) {
+        _numa_node = numa_node;
+    }
+
+    // Keep the receive path from ever taking a major fault, limited by RLIMIT_MEMLOCK
+    _locked = (mlock(_mem, _mem_size) == 0);
+    if (!_locked) {
+        dbfprintf(stderr, "mlock of %zu bytes failed, packet pool is pageable\n", _mem_size);
+    }
+
+    _packets = static_cast<chameleon_packet *>(_mem);
+    _buffers = static_cast<uint8_t *>(_mem) + descriptor_size;
+    for (size_t i = 0; i < _packet_cnt; i++) {
+        new(&_packets[i]) chameleon_packet(get_buffer(i), bytes_per_packet);
+    }
+}
+
+chameleon_packet_pool::~chameleon_packet_pool() {
+    if (_mem != nullptr) {
+        for (size_t i = 0; i < _packet_cnt; i++) {
+            _packets[i].~chameleon_packet();
+        }
+        if (_locked) {
+            munlock(_mem, _mem_size);
+        }
+        munmap(_mem, _mem_size);
+    }
+}
+
+chameleon_packet *chameleon_packet_pool::get(size_t i) const {
+    return &_packets[i];
+}
+
+size_t chameleon_packet_pool::index_of(const chameleon_packet *cp) const {
+    return static_cast<size_t>(cp - _packets);
+}
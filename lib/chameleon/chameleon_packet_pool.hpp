@@ -0,0 +1,78 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_PACKET_POOL_HPP
+#define CHAMELEON_PACKET_POOL_HPP
+#include <cstddef>
+#include <cstdint>
+
+namespace ihd {
+    class chameleon_packet;
+
+    /*!
+     * Fixed size pool of chameleon_packets carved out of a single mmap'ed slab.
+     *
+     * Slab layout: [packet descriptors][headroom][packet 0 buffer][headroom][packet 1 buffer]...
+     * The descriptors are stored densely at the front, every buffer starts on a cache line.
+     * The slab is locked in memory when the process is allowed to, and is backed by huge pages
+     * when asked for and available (falling back to regular pages with a transparent huge page hint).
+     * Given a NUMA node, the slab's pages are placed on it before they are first touched.
+     */
+    class chameleon_packet_pool {
+    public:
+        static constexpr size_t CACHE_LINE_SIZE = 64;
+        static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+        /*!
+         * \param numa_node node the slab's memory comes from, -1 for the node of the faulting thread
+         * \param headroom bytes kept free in front of every buffer, for a receive backend's own header
+         */
+        chameleon_packet_pool(size_t packet_cnt, size_t bytes_per_packet, bool huge_pages, int numa_node = -1,
+                              size_t headroom = 0);
+        ~chameleon_packet_pool();
+
+        chameleon_packet_pool(const chameleon_packet_pool &) = delete;
+        chameleon_packet_pool &operator=(const chameleon_packet_pool &) = delete;
+
+        [[nodiscard]] size_t size() const { return _packet_cnt; }
+
+        [[nodiscard]] chameleon_packet *get(size_t i) const;
+
+        /*! Index of a packet of this pool, the inverse of get() */
+        [[nodiscard]] size_t index_of(const chameleon_packet *cp) const;
+
+        /*! Start of packet i's buffer, buffers are get_buffer_stride() bytes apart */
+        [[nodiscard]] uint8_t *get_buffer(size_t i) const { return _buffers + _headroom + (i * _buffer_stride); }
+
+        /*! Free bytes in front of every buffer, at least the headroom asked for */
+        [[nodiscard]] size_t get_headroom() const { return _headroom; }
+
+        [[nodiscard]] size_t get_buffer_stride() const { return _buffer_stride; }
+
+        [[nodiscard]] size_t get_mem_size() const { return _mem_size; }
+
+        [[nodiscard]] bool is_huge() const { return _huge; }
+
+        [[nodiscard]] bool is_locked() const { return _locked; }
+
+        /*! Node the slab was bound to, -1 if it was not */
+        [[nodiscard]] int get_numa_node() const { return _numa_node; }
+
+    private:
+        size_t _packet_cnt;
+        size_t _headroom;
+        size_t _buffer_stride;
+        size_t _mem_size{};
+        bool _huge{};
+        bool _locked{};
+        int _numa_node{-1};
+        void *_mem{};
+        chameleon_packet *_packets{};
+        uint8_t *_buffers{};
+    };
+} // ihd
+
+#endif //CHAMELEON_PACKET_POOL_HPP
@@ -0,0 +1,190 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "chameleon_packet_ring.hpp"
+
+using namespace ihd;
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+static inline long futex_wait(std::atomic<uint32_t> *word, uint32_t expected, const timespec *timeout) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+}
+
+static inline long futex_wake(std::atomic<uint32_t> *word) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+void chameleon_ring_doorbell::notify() {
+    // Pairs with the fence in wait(): either the consumer sees the new data or we see it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_waiting.load(std::memory_order_relaxed)) {
+        _futex_word.fetch_add(1, std::memory_order_release);
+        futex_wake(&_futex_word);
+    }
+}
+
+void chameleon_ring_doorbell::wake() {
+    _wake_requested = true;
+    _futex_word.fetch_add(1, std::memory_order_release);
+    futex_wake(&_futex_word);
+}
+
+bool chameleon_ring_doorbell::sleep(uint32_t word, const std::chrono::steady_clock::time_point &deadline) {
+    auto remaining = deadline - std::chrono::steady_clock::now();
+    if (remaining <= std::chrono::nanoseconds::zero()) {
+        return false;
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+    timespec ts{};
+    ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+    ts.tv_nsec = static_cast<long>(ns % 1000000000);
+    futex_wait(&_futex_word, word, &ts);
+    return true;
+}
+
+chameleon_packet_ring::chameleon_packet_ring(size_t capacity) {
+    reset(capacity);
+}
+
+void chameleon_packet_ring::reset(size_t capacity, bool stealable) {
+    size_t n = 1;
+    while (n < capacity) {
+        n <<= 1;
+    }
+    _slots.assign(n, nullptr);
+    _mask = n - 1;
+    _stealable = stealable;
+    _head = 0;
+    _tail = 0;
+    _cached_head = 0;
+    _cached_tail = 0;
+}
+
+bool chameleon_packet_ring::push(chameleon_packet *packet) {
+    const size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _cached_head == _slots.size()) {
+        _cached_head = _head.load(std::memory_order_acquire);
+        if (tail - _cached_head == _slots.size()) {
+            return false; // Full
+        }
+    }
+    _slots[tail & _mask] = packet;
+    _tail.store(tail + 1, std::memory_order_release);
+    _doorbell->notify();
+    return true;
+}
+
+chameleon_packet *chameleon_packet_ring::pop() {
+    if (_stealable) {
+        chameleon_packet *packet = nullptr;
+        claim(&packet, 1);
+        return packet;
+    }
+    const size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _cached_tail) {
+        _cached_tail = _tail.load(std::memory_order_acquire);
+        if (head == _cached_tail) {
+            return nullptr; // Empty
+        }
+    }
+    chameleon_packet *packet = _slots[head & _mask];
+    _head.store(head + 1, std::memory_order_release);
+    return packet;
+}
+
+size_t chameleon_packet_ring::pop_bulk(chameleon_packet **packets, size_t n) {
+    if (_stealable) {
+        return claim(packets, n);
+    }
+    const size_t head = _head.load(std::memory_order_relaxed);
+    if (head + n > _cached_tail) {
+        _cached_tail = _tail.load(std::memory_order_acquire);
+    }
+    n = std::min(n, _cached_tail - head);
+    for (size_t i = 0; i < n; i++) {
+        packets[i] = _slots[(head + i) & _mask];
+    }
+    _head.store(head + n, std::memory_order_release);
+    return n;
+}
+
+chameleon_packet *chameleon_packet_ring::pop_wait(uint64_t timeout_ms) {
+    chameleon_packet *packet = pop();
+    if (packet == nullptr && wait_not_empty(timeout_ms)) {
+        packet = pop();
+    }
+    return packet;
+}
+
+chameleon_packet *chameleon_packet_ring::steal() {
+    chameleon_packet *packet = nullptr;
+    claim(&packet, 1);
+    return packet;
+}
+
+size_t chameleon_packet_ring::claim(chameleon_packet **packets, size_t n) {
+    // The ring is never full, so the slots between head and tail are not rewritten while they are read:
+    // whoever loses the race just retries from the new head
+    size_t head = _head.load(std::memory_order_acquire);
+    for (;;) {
+        const size_t available = _tail.load(std::memory_order_acquire) - head;
+        const size_t count = std::min(n, available);
+        if (count == 0) {
+            return 0;
+        }
+        for (size_t i = 0; i < count; i++) {
+            packets[i] = _slots[(head + i) & _mask];
+        }
+        if (_head.compare_exchange_weak(head, head + count, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return count;
+        }
+    }
+}
+
+bool chameleon_packet_ring::wait_not_empty(uint64_t timeout_ms) {
+    // Spin first - at line rate the next packet is usually only microseconds away
+    for (uint32_t i = 0; i < _spin_limit; i++) {
+        if (!empty()) {
+            _spin_limit = std::min(_spin_limit * 2, MAX_SPIN);
+            return true;
+        }
+        cpu_relax();
+    }
+    _spin_limit = std::max(_spin_limit / 2, MIN_SPIN);
+
+    return _doorbell->wait([this] { return !empty(); }, timeout_ms);
+}
+
+void chameleon_packet_ring::wake() {
+    _doorbell->wake();
+}
+
+void chameleon_packet_ring::set_doorbell(chameleon_ring_doorbell *doorbell) {
+    _doorbell = (doorbell != nullptr) ? doorbell : &_own_doorbell;
+}
+
+bool chameleon_packet_ring::empty() const {
+    return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_acquire);
+}
+
+size_t chameleon_packet_ring::size() const {
+    return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+}
@@ -0,0 +1,215 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_PACKET_RING_HPP
+#define CHAMELEON_PACKET_RING_HPP
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace ihd {
+    class chameleon_packet;
+
+    /*!
+     * Futex based wait/wake shared by the consumer of one or more rings.
+     *
+     * The producer only makes a futex syscall when a consumer is actually asleep. Several rings can ring
+     * the same doorbell, so a consumer of all of them sleeps once instead of polling each ring in turn.
+     */
+    class chameleon_ring_doorbell {
+    public:
+        static constexpr size_t CACHE_LINE_SIZE = 64;
+
+        chameleon_ring_doorbell() = default;
+
+        chameleon_ring_doorbell(const chameleon_ring_doorbell &) = delete;
+        chameleon_ring_doorbell &operator=(const chameleon_ring_doorbell &) = delete;
+
+        /*!
+         * Consumer: sleep until ready() returns true, wake() is called or timeout_ms expires
+         * \return the last result of ready()
+         */
+        template<typename Ready>
+        bool wait(Ready ready, uint64_t timeout_ms);
+
+        /*!
+         * Producer: called after publishing, wakes the consumer if it is asleep
+         */
+        void notify();
+
+        /*!
+         * Wake the consumer even though nothing was published, so it can re-check its run state
+         */
+        void wake();
+
+    private:
+        /*! Sleep until the futex word changes from word or the deadline passes
+         * \return false on timeout */
+        bool sleep(uint32_t word, const std::chrono::steady_clock::time_point &deadline);
+
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> _futex_word{0};
+        std::atomic<uint32_t> _waiting{0};
+        std::atomic<bool> _wake_requested{false};
+    };
+
+    template<typename Ready>
+    bool chameleon_ring_doorbell::wait(Ready ready, uint64_t timeout_ms) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        bool is_ready = false;
+        bool done = false;
+        while (!done) {
+            const uint32_t word = _futex_word.load(std::memory_order_acquire);
+            _waiting.store(1, std::memory_order_relaxed);
+            // Pairs with the fence in notify(): either we see the producer's data or it sees us waiting
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ready()) {
+                is_ready = true;
+                break;
+            }
+            if (!sleep(word, deadline)) {
+                break; // Timeout
+            }
+            is_ready = ready();
+            done = is_ready || _wake_requested.exchange(false);
+        }
+        _waiting.store(0, std::memory_order_relaxed);
+        return is_ready;
+    }
+
+    /*!
+     * Bounded lock-free single-producer/single-consumer ring of packet descriptors.
+     *
+     * One thread may push and one (other) thread may pop at the same time. The consumer can block in
+     * pop_wait(), which spins for a while and then sleeps on the ring's doorbell until the producer pushes
+     * or the timeout expires.
+     *
+     * A ring reset as stealable also lets the producer take back the oldest packet with steal(),
+     * the consumer then claims packets with a compare-and-swap on the head.
+     */
+    class chameleon_packet_ring {
+    public:
+        static constexpr size_t CACHE_LINE_SIZE = 64;
+
+        explicit chameleon_packet_ring(size_t capacity = 0);
+
+        chameleon_packet_ring(const chameleon_packet_ring &) = delete;
+        chameleon_packet_ring &operator=(const chameleon_packet_ring &) = delete;
+
+        /*!
+         * Resize the ring (rounded up to a power of 2) and discard its contents. Not thread safe.
+         * \param stealable allow steal(), the ring must then never be full
+         */
+        void reset(size_t capacity, bool stealable = false);
+
+        /*!
+         * Producer: add a packet
+         * \return false if the ring is full
+         */
+        bool push(chameleon_packet *packet);
+
+        /*!
+         * Consumer: remove a packet without waiting
+         * \return the oldest packet, nullptr when empty
+         */
+        chameleon_packet *pop();
+
+        /*!
+         * Consumer: remove up to n packets without waiting
+         * \return the number of packets written to packets
+         */
+        size_t pop_bulk(chameleon_packet **packets, size_t n);
+
+        /*!
+         * Consumer: remove a packet, waiting up to timeout_ms for one to arrive
+         * \return the oldest packet, nullptr on timeout or wake()
+         */
+        chameleon_packet *pop_wait(uint64_t timeout_ms);
+
+        /*!
+         * Producer of a stealable ring: take back the oldest packet before the consumer gets it
+         * \return the oldest packet, nullptr when empty
+         */
+        chameleon_packet *steal();
+
+        /*!
+         * Wake a consumer sleeping in pop_wait() so it can re-check its run state
+         */
+        void wake();
+
+        /*!
+         * Ring doorbell on every push instead of the ring's own, for a consumer waiting on several rings.
+         * Set before the ring is used, nullptr to go back to the ring's own doorbell.
+         */
+        void set_doorbell(chameleon_ring_doorbell *doorbell);
+
+        [[nodiscard]] bool empty() const;
+
+        [[nodiscard]] size_t size() const;
+
+        [[nodiscard]] size_t capacity() const { return _slots.size(); }
+
+    private:
+        static constexpr uint32_t MIN_SPIN = 64;
+        static constexpr uint32_t MAX_SPIN = 16384;
+
+        bool wait_not_empty(uint64_t timeout_ms);
+
+        /*! Claim up to n packets at the head when the producer may be stealing */
+        size_t claim(chameleon_packet **packets, size_t n);
+
+        std::vector<chameleon_packet *> _slots;
+        size_t _mask{};
+        bool _stealable{};
+
+        /* Consumer side */
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> _head{0};
+        size_t _cached_tail{0};
+        uint32_t _spin_limit{MIN_SPIN}; /* Grows when spinning finds data, shrinks when it has to sleep */
+
+        /* Producer side */
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> _tail{0};
+        size_t _cached_head{0};
+
+        chameleon_ring_doorbell _own_doorbell;
+        chameleon_ring_doorbell *_doorbell{&_own_doorbell};
+    };
+
+    template<typename T>
+    struct aligned_delete {
+        void operator()(T *p) const {
+            p->~T();
+            free(p);
+        }
+    };
+
+    /*!
+     * new for the objects holding rings or doorbells on the heap. Before C++17 operator new ignores
+     * their alignas(CACHE_LINE_SIZE), which would let the producer and consumer sides share a cache line.
+     * \throws std::bad_alloc
+     */
+    template<typename T, typename... Args>
+    std::unique_ptr<T, aligned_delete<T>> make_aligned(Args &&... args) {
+        void *mem = nullptr;
+        if (posix_memalign(&mem, std::max(alignof(T), sizeof(void *)), sizeof(T)) != 0) {
+            throw std::bad_alloc();
+        }
+        try {
+            return std::unique_ptr<T, aligned_delete<T>>(new(mem) T(std::forward<Args>(args)...));
+        } catch (...) {
+            free(mem);
+            throw;
+        }
+    }
+} // ihd
+
+#endif //CHAMELEON_PACKET_RING_HPP
@@ -0,0 +1,56 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include "chameleon_recv_link.hpp"
+#include "chameleon_packet.hpp"
+
+using namespace ihd;
+
+chameleon_recv_link::chameleon_recv_link(chameleon_packet_lanes &lanes,
+                                         size_t frame_size) : _lanes(lanes),
+                                                              _frame_size(frame_size) {
+}
+
+size_t chameleon_recv_link::get_num_recv_frames() const {
+    return _lanes.capacity();
+}
+
+size_t chameleon_recv_link::get_recv_frame_size() const {
+    return _frame_size;
+}
+
+transport::frame_buff::uptr chameleon_recv_link::get_recv_buff(int32_t timeout_ms) {
+    chameleon_packet *cp = nullptr;
+    if (timeout_ms == 0) {
+        cp = _lanes.pop();
+    } else if (timeout_ms > 0) {
+        cp = _lanes.pop_wait(static_cast<uint64_t>(timeout_ms));
+    } else {
+        while (cp == nullptr) {
+            cp = _lanes.pop_wait(UINT32_MAX);
+        }
+    }
+    if (cp == nullptr) {
+        return transport::frame_buff::uptr();
+    }
+    return cp->getFrameBuff();
+}
+
+void chameleon_recv_link::release_recv_buff(transport::frame_buff::uptr buff) {
+    chameleon_packet *cp = get_packet(buff);
+    if (cp != nullptr) {
+        _lanes.release(cp);
+    }
+}
+
+uhd::transport::adapter_id_t chameleon_recv_link::get_recv_adapter_id() const {
+    return uhd::transport::NULL_ADAPTER_ID;
+}
+
+chameleon_packet *chameleon_recv_link::get_packet(const transport::frame_buff::uptr &buff) {
+    auto *frame = static_cast<chameleon_frame_buff *>(buff.get());
+    return (frame != nullptr) ? frame->get_packet() : nullptr;
+}
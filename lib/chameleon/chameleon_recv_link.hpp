@@ -0,0 +1,46 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_RECV_LINK_HPP
+#define CHAMELEON_RECV_LINK_HPP
+
+#include "transport/link_if.hpp"
+#include "chameleon_packet_lanes.hpp"
+
+namespace ihd {
+
+/*!
+ * recv_link_if over the packet lanes of a chameleon_rx_stream.
+ *
+ * get_recv_buff() takes the next received packet off the sample queues and returns a frame_buff that
+ * points at its payload in the packet pool. release_recv_buff() puts the packet back on its free queue.
+ * Like the rings, it supports a single caller at a time - the rx stream serializes access.
+ */
+class chameleon_recv_link : public transport::recv_link_if {
+public:
+    chameleon_recv_link(chameleon_packet_lanes &lanes, size_t frame_size);
+
+    [[nodiscard]] size_t get_num_recv_frames() const override;
+
+    [[nodiscard]] size_t get_recv_frame_size() const override;
+
+    transport::frame_buff::uptr get_recv_buff(int32_t timeout_ms) override;
+
+    void release_recv_buff(transport::frame_buff::uptr buff) override;
+
+    [[nodiscard]] uhd::transport::adapter_id_t get_recv_adapter_id() const override;
+
+    /*! Packet the frame was borrowed from, for the stream's metadata */
+    static chameleon_packet *get_packet(const transport::frame_buff::uptr &buff);
+
+private:
+    chameleon_packet_lanes &_lanes;
+    size_t _frame_size;
+};
+
+} // ihd
+
+#endif //CHAMELEON_RECV_LINK_HPP
@@ -0,0 +1,55 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_RX_BACKEND_HPP
+#define CHAMELEON_RX_BACKEND_HPP
+#include <cstddef>
+#include <memory>
+
+namespace ihd {
+    class chameleon_packet;
+
+    /*!
+     * Source of VITA datagrams for the rx stream receive thread.
+     * A backend is used by one thread at a time: its receive thread, or the reactor thread serving it.
+     */
+    class chameleon_rx_backend {
+    public:
+        typedef std::unique_ptr<chameleon_rx_backend> uptr;
+
+        virtual ~chameleon_rx_backend() = default;
+
+        /*!
+         * Receive up to n datagrams into the packets' buffers and set each packet's size.
+         * Blocks up to the backend's timeout for the first datagram, then takes whatever else is ready.
+         * Datagrams too short for the CHDR header and timestamp are dropped, the filled packets come first.
+         * \return the number of packets filled, 0 on timeout, -1 on error (errno set)
+         */
+        virtual int receive(chameleon_packet **packets, size_t n) = 0;
+
+        /*!
+         * Hand the first n packets filled by the last receive() back without taking them out of the batch,
+         * the caller discarded them and receives into the same batch again.
+         * Needed by backends that keep packets of the batch across calls.
+         */
+        virtual void reuse(chameleon_packet ** /*packets*/, size_t /*n*/) {}
+
+        /*!
+         * Datagrams the kernel dropped before the backend could read them.
+         * May make a system call, so poll it now and then rather than after every receive().
+         * \return the count since the backend was opened
+         */
+        virtual uint64_t get_drops() { return 0; }
+
+        /*!
+         * File descriptor that polls readable when receive() has datagrams to return
+         * \return -1 if the backend can't be waited on with poll/epoll
+         */
+        [[nodiscard]] virtual int get_fd() const { return -1; }
+    };
+} // ihd
+
+#endif //CHAMELEON_RX_BACKEND_HPP
@@ -0,0 +1,176 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <uhd/exception.hpp>
+
+#include "chameleon_rx_reactor.hpp"
+#include "chameleon_log.hpp"
+#include "debug.hpp"
+
+using namespace ihd;
+
+chameleon_rx_reactor::sptr chameleon_rx_reactor::get(size_t n_threads) {
+    static std::mutex instance_mtx;
+    static std::weak_ptr<chameleon_rx_reactor> instance;
+
+    std::lock_guard<std::mutex> lock(instance_mtx);
+    sptr reactor = instance.lock();
+    if (!reactor) {
+        reactor = sptr(new chameleon_rx_reactor(std::max<size_t>(n_threads, 1)));
+        instance = reactor;
+    } else if (n_threads != reactor->get_num_threads()) {
+        dbfprintf(stderr, "rx reactor already running with %zu threads\n", reactor->get_num_threads());
+    }
+    return reactor;
+}
+
+chameleon_rx_reactor::chameleon_rx_reactor(const size_t n_threads) {
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    _wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_epoll_fd < 0 || _wake_fd < 0) {
+        perror("rx reactor epoll/eventfd creation failed");
+        throw uhd::runtime_error("rx reactor creation failed");
+    }
+    // Level triggered and never read: once written it wakes every thread, which is what stopping wants
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = WAKE_ID;
+    epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &ev);
+
+    for (size_t i = 0; i < n_threads; i++) {
+        _threads.emplace_back([this] { thread_func(); });
+    }
+    dbprintf("rx reactor started with %zu threads\n", n_threads);
+}
+
+chameleon_rx_reactor::~chameleon_rx_reactor() {
+    _run = false;
+    uint64_t one = 1;
+    if (write(_wake_fd, &one, sizeof(one)) < 0) {
+        perror("rx reactor wake failed");
+    }
+    for (std::thread &t: _threads) {
+        t.join();
+    }
+    close(_wake_fd);
+    close(_epoll_fd);
+}
+
+uint64_t chameleon_rx_reactor::add(int fd, handler_t handler, std::function<bool()> can_receive) {
+    std::shared_ptr<entry_t> e(new entry_t);
+    e->fd = fd;
+    e->handler = std::move(handler);
+    e->can_receive = std::move(can_receive);
+    {
+        std::lock_guard<std::mutex> lock(_entries_mtx);
+        e->id = _next_id++;
+        _entries[e->id] = e;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.u64 = e->id;
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        perror("rx reactor EPOLL_CTL_ADD failed");
+        std::lock_guard<std::mutex> lock(_entries_mtx);
+        _entries.erase(e->id);
+        throw uhd::runtime_error("rx reactor add failed");
+    }
+    return e->id;
+}
+
+void chameleon_rx_reactor::remove(const uint64_t id) {
+    std::shared_ptr<entry_t> e;
+    {
+        std::lock_guard<std::mutex> lock(_entries_mtx);
+        auto it = _entries.find(id);
+        if (it == _entries.end()) {
+            return;
+        }
+        e = it->second;
+        _entries.erase(it);
+    }
+    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, e->fd, nullptr);
+    // Wait for a handler that is running, a thread that finds the entry later sees it removed
+    std::lock_guard<std::mutex> lock(e->mtx);
+    e->removed = true;
+}
+
+void chameleon_rx_reactor::thread_func() {
+    epoll_event events[MAX_EVENTS];
+    std::vector<std::shared_ptr<entry_t>> parked; /* Sockets this thread parked */
+    while (_run) {
+        const int n = epoll_wait(_epoll_fd, events, MAX_EVENTS, parked.empty() ? -1 : PARKED_POLL_MS);
+        if (n < 0 && errno != EINTR) {
+            rlprintf("rx reactor epoll_wait failed: %s\n", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < n && _run; i++) {
+            if (events[i].data.u64 == WAKE_ID) {
+                continue;
+            }
+            std::shared_ptr<entry_t> e;
+            {
+                std::lock_guard<std::mutex> lock(_entries_mtx);
+                auto it = _entries.find(events[i].data.u64);
+                if (it != _entries.end()) {
+                    e = it->second;
+                }
+            }
+            if (e) {
+                dispatch(e, parked);
+            }
+        }
+        if (!parked.empty()) {
+            retry_parked(parked);
+        }
+    }
+}
+
+void chameleon_rx_reactor::dispatch(const std::shared_ptr<entry_t> &e, std::vector<std::shared_ptr<entry_t>> &parked) {
+    std::lock_guard<std::mutex> lock(e->mtx);
+    if (e->removed) {
+        return;
+    }
+    if (e->handler()) {
+        arm(e);
+    } else {
+        parked.push_back(e);
+    }
+}
+
+void chameleon_rx_reactor::retry_parked(std::vector<std::shared_ptr<entry_t>> &parked) {
+    auto it = parked.begin();
+    while (it != parked.end()) {
+        const std::shared_ptr<entry_t> &e = *it;
+        std::unique_lock<std::mutex> lock(e->mtx);
+        if (e->removed) {
+            lock.unlock();
+            it = parked.erase(it);
+        } else if (e->can_receive()) {
+            arm(e);
+            lock.unlock();
+            it = parked.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void chameleon_rx_reactor::arm(const std::shared_ptr<entry_t> &e) const {
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.u64 = e->id;
+    // Fails with ENOENT when remove() got there first, which is fine
+    epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, e->fd, &ev);
+}
@@ -0,0 +1,104 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_RX_REACTOR_HPP
+#define CHAMELEON_RX_REACTOR_HPP
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ihd {
+    /*!
+     * A fixed pool of threads receiving for any number of rx streams.
+     *
+     * Every thread waits in epoll_wait() on one shared epoll set holding the receive sockets of all the
+     * streams using the reactor. A socket is registered EPOLLONESHOT, so only one thread at a time runs
+     * its handler (the packet rings stay single producer), and it is re-armed when the handler is done.
+     * A handler that has no free packets to receive into parks its socket: the thread re-arms it once
+     * can_receive() says the consumer has given packets back.
+     *
+     * The reactor is shared by every stream of the process, see get().
+     */
+    class chameleon_rx_reactor {
+    public:
+        typedef std::shared_ptr<chameleon_rx_reactor> sptr;
+
+        /*!
+         * Called when the socket is readable
+         * \return false to park the socket until can_receive() returns true
+         */
+        typedef std::function<bool()> handler_t;
+
+        /*!
+         * The reactor of the process, started with n_threads threads by the first stream asking for it
+         * and stopped when the last stream lets go of it
+         */
+        static sptr get(size_t n_threads);
+
+        ~chameleon_rx_reactor();
+
+        chameleon_rx_reactor(const chameleon_rx_reactor &) = delete;
+        chameleon_rx_reactor &operator=(const chameleon_rx_reactor &) = delete;
+
+        [[nodiscard]] size_t get_num_threads() const { return _threads.size(); }
+
+        /*!
+         * Start calling handler whenever fd is readable
+         * \return the id to remove() it with
+         * \throws uhd::runtime_error if fd can't be added to the epoll set
+         */
+        uint64_t add(int fd, handler_t handler, std::function<bool()> can_receive);
+
+        /*!
+         * Stop serving a socket. When this returns its handler is not running and will not run again,
+         * so the caller may close the socket and free what the handler uses.
+         */
+        void remove(uint64_t id);
+
+    private:
+        static constexpr uint64_t WAKE_ID = 0; /* epoll data of the eventfd that stops the threads */
+        static constexpr int PARKED_POLL_MS = 10;
+        static constexpr int MAX_EVENTS = 64;
+
+        typedef struct entry {
+            uint64_t id;
+            int fd;
+            handler_t handler;
+            std::function<bool()> can_receive;
+            std::mutex mtx; /* Held while the handler runs */
+            bool removed{};
+        } entry_t;
+
+        explicit chameleon_rx_reactor(size_t n_threads);
+
+        void thread_func();
+
+        /*! Run an entry's handler and re-arm or park it */
+        void dispatch(const std::shared_ptr<entry_t> &e, std::vector<std::shared_ptr<entry_t>> &parked);
+
+        /*! Re-arm the parked entries whose consumer has freed packets */
+        void retry_parked(std::vector<std::shared_ptr<entry_t>> &parked);
+
+        void arm(const std::shared_ptr<entry_t> &e) const;
+
+        int _epoll_fd{-1};
+        int _wake_fd{-1};
+        std::atomic<bool> _run{true};
+        std::vector<std::thread> _threads;
+
+        std::mutex _entries_mtx;
+        std::unordered_map<uint64_t, std::shared_ptr<entry_t>> _entries;
+        uint64_t _next_id{WAKE_ID + 1};
+    };
+} // ihd
+
+#endif //CHAMELEON_RX_REACTOR_HPP
@@ -4,15 +4,30 @@
 * SPDX-License-Identifier: GPL-3.0-or-later
 */
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
 #include <iostream>
+#include <vector>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <sched.h>
+#include <cstring>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
 
 #include <uhd/transport/udp_simple.hpp>
 
 #include "chameleon_fw_common.hpp"
 #include "chameleon_rx_stream.hpp"
 #include "chameleon_packet.hpp"
+#include "chameleon_socket_rx.hpp"
+#include "chameleon_af_packet_rx.hpp"
+#include "chameleon_uring_rx.hpp"
+#include "chameleon_numa.hpp"
+#include "chameleon_log.hpp"
+#include "transport/udp_common.hpp"
 #include <exception.hpp>
 #include "debug.hpp"
 
@@ -26,21 +41,33 @@ chameleon_rx_stream::chameleon_rx_stream(const uhd::stream_args_t &stream_cmd,
         ihd::ipsolon_rx_stream::stream_type::PSD_STREAM),
     _max_samples_per_packet((DEFAULT_PACKET_SIZE - PACKET_HEADER_SIZE) / BYTES_PER_IQ_PAIR),
     _buffer_packet_cnt(0),
-    _commander(device_addr),
+    _commander(chameleon_fw_commander::get(device_addr)),
     _vita_ip_str(DEFAULT_VITA_IP_STR),
     _vita_ip(DEFAULT_VITA_IP),
     _vita_port(DEFAULT_VITA_PORT),
+    _recv_batch_size(DEFAULT_RECV_BATCH),
+    _recv_backend(ipsolon_rx_stream::stream_type::SOCKET_BACKEND),
+    _recv_steering(ipsolon_rx_stream::stream_type::SEQ_STEERING),
+    _overflow_policy(ipsolon_rx_stream::stream_type::BLOCK_OVERFLOW),
     _nChans(stream_cmd.channels.size()),
-    _current_packet(nullptr),
-    _receive_thread_context{} {
-    if (stream_cmd.cpu_format != "sc16") {
-        THROW_VALUE_NOT_SUPPORTED_ERROR(stream_cmd.args.to_string());
-    }
+    _current_packet(nullptr) {
+    _device_args = device_addr;
+    _stream_args = stream_cmd.args;
     if (stream_cmd.otw_format != "sc16") {
         THROW_VALUE_NOT_SUPPORTED_ERROR(stream_cmd.args.to_string());
     }
-    for (const size_t &chan: stream_cmd.channels) {
+    // Throws for an unsupported cpu_format
+    _converter = chameleon_converter(stream_cmd.cpu_format, stream_cmd.args.cast<double>("fullscale", 1.0));
+    dbprintf("cpu_format %s converter: %s\n", stream_cmd.cpu_format.c_str(), _converter.get_isa().c_str());
+    _vc_to_channel.fill(NO_CHANNEL);
+    _channels.resize(std::max<size_t>(_nChans, 1));
+    for (size_t i = 0; i < _nChans; i++) {
+        const size_t chan = stream_cmd.channels[i];
+        if (chan < 1 || chan > MAX_RX_CHANNELS) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(std::to_string(chan));
+        }
         _chanMask |= 1 << (chan - 1); /* Channels indexed at 1 */
+        _vc_to_channel[chan - 1] = static_cast<int8_t>(i); /* The CHDR virtual channel is indexed at 0 */
     }
     if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::STREAM_DEST_IP_KEY)) {
         _vita_ip_str.assign(stream_cmd.args[ipsolon_rx_stream::stream_type::STREAM_DEST_IP_KEY]);
@@ -55,34 +82,209 @@ chameleon_rx_stream::chameleon_rx_stream(const uhd::stream_args_t &stream_cmd,
         _vita_port = std::stoul(port_str, nullptr, 10);
     }
 
-    _receive_thread_context.run = false;
-    _receive_thread_context.q_free = &q_free_packets;
-    _receive_thread_context.q_samples = &q_sample_packets;
-    _receive_thread_context.mtx_free = &mtx_free_queue;
-    _receive_thread_context.mtx_samples = &mtx_sample_queue;
-    _receive_thread_context.cv_free = &cv_free_queue;
-    _receive_thread_context.cv_samples = &cv_sample_queue;
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::RECV_BATCH_KEY)) {
+        std::string batch_str = stream_cmd.args[ipsolon_rx_stream::stream_type::RECV_BATCH_KEY];
+        _recv_batch_size = std::stoul(batch_str, nullptr, 10);
+        if (_recv_batch_size < 1 || _recv_batch_size > MAX_RECV_BATCH) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(batch_str);
+        }
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::HUGE_PAGES_KEY)) {
+        _huge_pages = (stream_cmd.args[ipsolon_rx_stream::stream_type::HUGE_PAGES_KEY] == "true");
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::RECV_BACKEND_KEY)) {
+        _recv_backend = stream_cmd.args[ipsolon_rx_stream::stream_type::RECV_BACKEND_KEY];
+        if (_recv_backend != ipsolon_rx_stream::stream_type::SOCKET_BACKEND &&
+            _recv_backend != ipsolon_rx_stream::stream_type::AF_PACKET_BACKEND &&
+            _recv_backend != ipsolon_rx_stream::stream_type::URING_BACKEND) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(_recv_backend);
+        }
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::RECV_CPU_KEY)) {
+        std::string cpu_str = stream_cmd.args[ipsolon_rx_stream::stream_type::RECV_CPU_KEY];
+        _recv_cpu = std::stoi(cpu_str, nullptr, 10);
+        if (_recv_cpu < 0 || _recv_cpu >= CPU_SETSIZE) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(cpu_str);
+        }
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::RECV_PRIORITY_KEY)) {
+        std::string priority_str = stream_cmd.args[ipsolon_rx_stream::stream_type::RECV_PRIORITY_KEY];
+        _recv_priority = std::stoi(priority_str, nullptr, 10);
+        if (_recv_priority < sched_get_priority_min(SCHED_FIFO) ||
+            _recv_priority > sched_get_priority_max(SCHED_FIFO)) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(priority_str);
+        }
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::BUSY_POLL_KEY)) {
+        std::string busy_poll_str = stream_cmd.args[ipsolon_rx_stream::stream_type::BUSY_POLL_KEY];
+        _busy_poll_usec = std::stoi(busy_poll_str, nullptr, 10);
+        if (_busy_poll_usec < 0) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(busy_poll_str);
+        }
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::RECV_SPIN_KEY)) {
+        _recv_spin = (stream_cmd.args[ipsolon_rx_stream::stream_type::RECV_SPIN_KEY] == "true");
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::RECV_THREADS_KEY)) {
+        std::string threads_str = stream_cmd.args[ipsolon_rx_stream::stream_type::RECV_THREADS_KEY];
+        _recv_threads = std::stoul(threads_str, nullptr, 10);
+        if (_recv_threads < 1 || _recv_threads > MAX_RECV_THREADS) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(threads_str);
+        }
+        if (_recv_cpu >= 0 && _recv_cpu + _recv_threads > CPU_SETSIZE) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(threads_str);
+        }
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::RECV_STEERING_KEY)) {
+        _recv_steering = stream_cmd.args[ipsolon_rx_stream::stream_type::RECV_STEERING_KEY];
+        if (_recv_steering != ipsolon_rx_stream::stream_type::SEQ_STEERING &&
+            _recv_steering != ipsolon_rx_stream::stream_type::HASH_STEERING) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(_recv_steering);
+        }
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::OVERFLOW_POLICY_KEY)) {
+        _overflow_policy = stream_cmd.args[ipsolon_rx_stream::stream_type::OVERFLOW_POLICY_KEY];
+        if (_overflow_policy != ipsolon_rx_stream::stream_type::BLOCK_OVERFLOW &&
+            _overflow_policy != ipsolon_rx_stream::stream_type::DROP_NEWEST_OVERFLOW &&
+            _overflow_policy != ipsolon_rx_stream::stream_type::DROP_OLDEST_OVERFLOW) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(_overflow_policy);
+        }
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::SAMPLE_RATE_KEY)) {
+        std::string rate_str = stream_cmd.args[ipsolon_rx_stream::stream_type::SAMPLE_RATE_KEY];
+        _sample_rate = std::stod(rate_str);
+        if (!(_sample_rate > 0.0)) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(rate_str);
+        }
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::BUFFER_TIME_KEY)) {
+        std::string time_str = stream_cmd.args[ipsolon_rx_stream::stream_type::BUFFER_TIME_KEY];
+        _buffer_time_ms = std::stod(time_str);
+        // A time is only a size once the rate is known
+        if (!(_buffer_time_ms > 0.0) || _sample_rate == 0.0) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(time_str);
+        }
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::BUFFER_BYTES_KEY)) {
+        std::string bytes_str = stream_cmd.args[ipsolon_rx_stream::stream_type::BUFFER_BYTES_KEY];
+        _buffer_bytes = std::stoull(bytes_str, nullptr, 10);
+        if (_buffer_bytes == 0) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(bytes_str);
+        }
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::NUMA_NODE_KEY)) {
+        std::string node_str = stream_cmd.args[ipsolon_rx_stream::stream_type::NUMA_NODE_KEY];
+        _numa_node = std::stoi(node_str, nullptr, 10);
+        if (_numa_node >= 0 && !chameleon_numa::get_node_cpus(_numa_node, _numa_cpus)) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(node_str);
+        }
+    } else {
+        // Keep the packets and the threads touching them on the socket the NIC is attached to
+        _numa_node = chameleon_numa::get_interface_node(_vita_ip);
+        if (!chameleon_numa::get_node_cpus(_numa_node, _numa_cpus)) {
+            _numa_node = chameleon_numa::NO_NODE;
+        }
+    }
+
+    if (stream_cmd.args.has_key(ipsolon_rx_stream::stream_type::REACTOR_THREADS_KEY)) {
+        std::string reactor_str = stream_cmd.args[ipsolon_rx_stream::stream_type::REACTOR_THREADS_KEY];
+        _reactor_threads = std::stoul(reactor_str, nullptr, 10);
+        // io_uring completions can't be waited on with epoll here
+        if (_reactor_threads > MAX_REACTOR_THREADS ||
+            (_reactor_threads > 0 && _recv_backend == ipsolon_rx_stream::stream_type::URING_BACKEND)) {
+            THROW_VALUE_NOT_SUPPORTED_ERROR(reactor_str);
+        }
+        if (_reactor_threads > 0) {
+            _reactor = chameleon_rx_reactor::get(_reactor_threads);
+        }
+    }
+
+    for (size_t i = 0; i < _recv_threads; i++) {
+        std::unique_ptr<receive_thread_context_t> rtc(new receive_thread_context_t{});
+        rtc->run = false;
+        rtc->lane = i;
+        _receive_threads.push_back(std::move(rtc));
+    }
 
     config_stream();
 }
 
 chameleon_rx_stream::~chameleon_rx_stream() {
     stop_stream();
-    while (!q_free_packets.empty()) {
-        chameleon_packet *pk = q_free_packets.front();
-        q_free_packets.pop();
-        delete pk;
+    dbprintf("Destructor send stream_rm for stream_id = %d\n",_stream_id);
+    chameleon_fw_comms stream_remove_cmd{chameleon_fw_stream_remove(_stream_id)};
+    _commander->send_request(stream_remove_cmd);
+
+}
+
+void chameleon_rx_stream::init_packet_queues(size_t bytes_per_packet, size_t default_packet_cnt) {
+    const size_t samples_per_packet = (bytes_per_packet - ipsolon_rx_stream::PACKET_HEADER_SIZE) / BYTES_PER_IQ_PAIR;
+    // Every packet carries one channel
+    const double packet_rate = _sample_rate * static_cast<double>(std::max<size_t>(_nChans, 1)) /
+                               static_cast<double>(samples_per_packet);
+    size_t mem_size = default_packet_cnt * bytes_per_packet;
+    if (_buffer_time_ms > 0.0) {
+        mem_size = static_cast<size_t>(std::ceil(_buffer_time_ms / 1000.0 * packet_rate)) * bytes_per_packet;
+        if (_buffer_bytes > 0) {
+            mem_size = std::min(mem_size, _buffer_bytes);
+        }
+    } else if (_buffer_bytes > 0) {
+        mem_size = _buffer_bytes;
     }
-    while (!q_sample_packets.empty()) {
-        chameleon_packet *pk = q_sample_packets.front();
-        q_sample_packets.pop();
-        delete pk;
+    // Every receive thread needs a couple of batches to keep receiving while the application holds some
+    const size_t min_packets = 2 * _recv_batch_size * _recv_threads;
+    _buffer_packet_cnt = std::max(mem_size / bytes_per_packet, min_packets);
+    if (_buffer_time_ms > 0.0 || _buffer_bytes > 0) {
+        // Each socket carries its share of the traffic for as long as the pool does
+        _socket_buffer_size = std::max<size_t>(_buffer_packet_cnt * bytes_per_packet / _recv_threads,
+                                               bytes_per_packet);
     }
-    dbprintf("Destructor send stream_rm for stream_id = %d\n",_stream_id);
-    std::unique_ptr<chameleon_fw_cmd> stream_remove(new chameleon_fw_stream_remove(_stream_id));
-    chameleon_fw_comms stream_remove_cmd(std::move(stream_remove));
-    _commander.send_request(stream_remove_cmd);
 
+    // The link args every UHD transport takes win over the sizes worked out above
+    transport::link_params_t default_params;
+    default_params.recv_frame_size = bytes_per_packet;
+    default_params.num_recv_frames = _buffer_packet_cnt;
+    default_params.recv_buff_size = _socket_buffer_size;
+    const transport::link_params_t params = transport::calculate_udp_link_params(
+        transport::link_type_t::RX_DATA, 0, bytes_per_packet, default_params, _device_args, _stream_args);
+    if (params.recv_frame_size < bytes_per_packet) {
+        // A frame must hold the largest datagram the radio sends
+        THROW_VALUE_NOT_SUPPORTED_ERROR(std::to_string(params.recv_frame_size));
+    }
+    _buffer_packet_cnt = std::max(params.num_recv_frames, min_packets);
+    _socket_buffer_size = params.recv_buff_size;
+
+    // io_uring's recvmsg writes its header and the sender in front of the payload
+    const size_t headroom = (_recv_backend == ipsolon_rx_stream::stream_type::URING_BACKEND) ?
+                            chameleon_uring_rx::HEADROOM : 0;
+    _packet_pool.reset(new chameleon_packet_pool(_buffer_packet_cnt, bytes_per_packet, _huge_pages, _numa_node,
+                                                 headroom));
+    const double pool_ms = (packet_rate > 0.0) ? static_cast<double>(_buffer_packet_cnt) / packet_rate * 1000.0 : 0.0;
+    UHD_LOGGER_INFO("CHAMELEON") << boost::format("RX packet pool: %d packets of %d bytes (%d bytes, %.1f ms), "
+                                                  "socket buffer: %d bytes, NUMA node: %d")
+                                    % _buffer_packet_cnt % bytes_per_packet % _packet_pool->get_mem_size()
+                                    % pool_ms % _socket_buffer_size % _packet_pool->get_numa_node();
+    dbprintf("packet pool huge pages:%d locked:%d\n", _packet_pool->is_huge(), _packet_pool->is_locked());
+    _lanes.reset(_packet_pool.get(), _recv_threads,
+                 _overflow_policy == ipsolon_rx_stream::stream_type::DROP_OLDEST_OVERFLOW);
+    for (std::unique_ptr<receive_thread_context_t> &rtc: _receive_threads) {
+        rtc->free_packets = &_lanes.get_free_ring(rtc->lane);
+        rtc->sample_packets = &_lanes.get_sample_ring(rtc->lane);
+    }
+    _recv_link.reset(new chameleon_recv_link(_lanes, bytes_per_packet - ipsolon_rx_stream::PACKET_HEADER_SIZE));
 }
 
 size_t chameleon_rx_stream::get_num_channels() const {
@@ -93,56 +295,83 @@ size_t chameleon_rx_stream::get_max_num_samps() const {
     return _max_samples_per_packet;
 }
 
+ipsolon_rx_stream::stream_stats_t chameleon_rx_stream::get_stats() const {
+    stream_stats_t stats{};
+    for (const std::unique_ptr<receive_thread_context_t> &rtc: _receive_threads) {
+        stats.packets += rtc->packets.load(std::memory_order_relaxed);
+        stats.recv_calls += rtc->recv_calls.load(std::memory_order_relaxed);
+        stats.bytes += rtc->bytes.load(std::memory_order_relaxed);
+        stats.free_starvation += rtc->free_starvation.load(std::memory_order_relaxed);
+        stats.queue_high_water = std::max(stats.queue_high_water,
+                                          rtc->queue_high_water.load(std::memory_order_relaxed));
+        stats.socket_drops += rtc->socket_drops.load(std::memory_order_relaxed);
+        stats.overflow_drops += rtc->overflow_drops.load(std::memory_order_relaxed);
+    }
+    stats.pool_packets = _lanes.capacity();
+    stats.pool_bytes = (_packet_pool != nullptr) ? _packet_pool->get_mem_size() : 0;
+    stats.socket_buffer = _socket_buffer_granted.load(std::memory_order_relaxed);
+    stats.dropped_packets = _dropped_packets.load(std::memory_order_relaxed);
+    stats.reorder_events = _reorder_events.load(std::memory_order_relaxed) + _lanes.get_reorder_events();
+    return stats;
+}
+
+int chameleon_rx_stream::get_ready_fd() {
+    std::lock_guard<std::mutex> stream_lock(mtx_stream);
+    return _lanes.get_ready_fd();
+}
+
+void chameleon_rx_stream::async_wait_ready(ready_callback_t callback) {
+    {
+        std::lock_guard<std::mutex> stream_lock(mtx_stream);
+        // Packets taken from the lanes but not read yet: a partly read one, or one for every channel
+        bool held = (_current_packet != nullptr);
+        if (_nChans > 1) {
+            held = std::all_of(_channels.begin(), _channels.end(),
+                               [](const channel_state_t &channel) { return !channel.packets.empty(); });
+        }
+        if (!held) {
+            callback = _lanes.set_ready_waiter(std::move(callback));
+        }
+    }
+    // Outside the lock, the callback may go straight back to recv()
+    if (callback) {
+        callback(true);
+    }
+}
+
+void chameleon_rx_stream::set_packet_callback(packet_callback_t callback) {
+    if (_receive_threads[0]->run) {
+        // The receive threads read it without a lock
+        throw uhd::runtime_error("set_packet_callback() while streaming");
+    }
+    _packet_callback = std::move(callback);
+}
+
 size_t chameleon_rx_stream::get_packet_data(size_t n_samples,
-                                            chameleon_data_type *buff,
+                                            void *buff,
                                             uhd::rx_metadata_t &metadata,
                                             uint64_t timeout_ms) {
     std::lock_guard<std::mutex> stream_lock(mtx_stream);
     size_t n = 0;
-    static int count = 0;
-    count++;
 
     if (_current_packet == nullptr) {
-        std::unique_lock<std::mutex> lock(mtx_sample_queue);
-        auto now = std::chrono::system_clock::now();
-        auto then = now + std::chrono::milliseconds(timeout_ms);
-        auto ret = cv_sample_queue.wait_until(lock, then, [this] { return !q_sample_packets.empty(); });
-        if (!ret) {
-            // Timeout and predicate is still false
+        _current_packet = _lanes.pop_wait(timeout_ms);
+        if (_current_packet == nullptr) {
+            // Timeout
             metadata.error_code = uhd::rx_metadata_t::ERROR_CODE_TIMEOUT;
         } else {
-            _current_packet = q_sample_packets.front();
-            q_sample_packets.pop();
-
-            metadata.reset();
-            metadata.has_time_spec = true;
-            metadata.time_spec = uhd::time_spec_t(
-                static_cast<double>(_current_packet->getTimestamp()) / 1000000000);
-
-            uint16_t seq = _current_packet->getCHDR().get_seq_num();
-            uint16_t expected = _previous_seq + 1;
-            metadata.out_of_sequence = (!_first_packet) && expected != seq;
-            if (metadata.out_of_sequence) {
-                metadata.error_code = uhd::rx_metadata_t::ERROR_CODE_OVERFLOW;
-                fprintf(stderr, "Previous seq:%x Current:%x missing:%d count:%d\n",
-                        _previous_seq, seq, seq - _previous_seq, count);
-            }
-            _first_packet = false;
-            _previous_seq = seq;
+            set_packet_metadata(_current_packet, metadata);
         }
-        lock.unlock();
     } else {
         metadata.fragment_offset = _current_packet->getPos();
     }
     // If anything went wrong about the _current_packet will still be null
     if (_current_packet != nullptr) {
-        n = _current_packet->getSamples(buff, n_samples);
+        n = _current_packet->getSamples(buff, n_samples, _converter);
 
         if (_current_packet->endOfPacket()) {
-            std::lock_guard<std::mutex> free_lock(mtx_free_queue);
-            q_free_packets.push(_current_packet);
+            _lanes.release(_current_packet);
             _current_packet = nullptr;
-            cv_free_queue.notify_one();
         } else {
             metadata.more_fragments = true;
         }
@@ -150,26 +379,215 @@ size_t chameleon_rx_stream::get_packet_data(size_t n_samples,
     return n;
 }
 
+void chameleon_rx_stream::set_packet_metadata(const chameleon_packet *cp, uhd::rx_metadata_t &metadata) {
+    metadata.reset();
+    metadata.has_time_spec = true;
+    metadata.time_spec = uhd::time_spec_t(
+        static_cast<double>(cp->getTimestamp()) / 1000000000);
+
+    channel_state_t *channel = get_channel(cp);
+    if (channel != nullptr && !check_sequence(*channel, cp)) {
+        metadata.out_of_sequence = true;
+        metadata.error_code = uhd::rx_metadata_t::ERROR_CODE_OVERFLOW;
+    }
+}
+
+bool chameleon_rx_stream::check_sequence(channel_state_t &channel, const chameleon_packet *cp) {
+    const uint16_t seq = cp->getCHDR().get_seq_num();
+    if (channel.first_packet) {
+        channel.first_packet = false;
+        channel.previous_seq = seq;
+        return true;
+    }
+    // Distance from the expected sequence number modulo 2^16, so 0xffff -> 0 is in sequence
+    const auto gap = static_cast<int16_t>(seq - static_cast<uint16_t>(channel.previous_seq + 1));
+    if (gap > 0) {
+        _dropped_packets.store(_dropped_packets.load(std::memory_order_relaxed) + gap, std::memory_order_relaxed);
+        rlprintf("Previous seq:%x Current:%x missing:%d\n", channel.previous_seq, seq, gap);
+        channel.previous_seq = seq;
+    } else if (gap < 0) {
+        // Late or duplicate, the channel stays at the newest packet
+        _reorder_events.store(_reorder_events.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    } else {
+        channel.previous_seq = seq;
+    }
+    return gap == 0;
+}
+
+chameleon_rx_stream::channel_state_t *chameleon_rx_stream::get_channel(const chameleon_packet *cp) {
+    if (_nChans <= 1) {
+        return &_channels[0]; // Everything on the socket belongs to the only channel
+    }
+    int8_t index = _vc_to_channel[cp->getCHDR().get_vc()];
+    return (index == NO_CHANNEL) ? nullptr : &_channels[index];
+}
+
+bool chameleon_rx_stream::align_channels(uint64_t timeout_ms, bool &realigned) {
+    for (;;) {
+        // Demultiplex until every channel has a packet
+        for (channel_state_t &channel: _channels) {
+            while (channel.packets.empty()) {
+                chameleon_packet *cp = _lanes.pop_wait(timeout_ms);
+                if (cp == nullptr) {
+                    return false; // Timeout
+                }
+                channel_state_t *owner = get_channel(cp);
+                if (owner == nullptr) {
+                    _lanes.release(cp); // Not one of this stream's channels
+                } else {
+                    owner->packets.push_back(cp);
+                }
+            }
+        }
+
+        // All channels use the same packet size, so they stay aligned while their front packets are read
+        uint64_t newest = 0;
+        for (const channel_state_t &channel: _channels) {
+            const chameleon_packet *cp = channel.packets.front();
+            if (cp->getPos() > 0) {
+                return true;
+            }
+            newest = std::max(newest, cp->getTimestamp());
+        }
+
+        // Drop the packets older than the newest front packet
+        bool aligned = true;
+        for (channel_state_t &channel: _channels) {
+            while (!channel.packets.empty() && channel.packets.front()->getTimestamp() < newest) {
+                chameleon_packet *cp = channel.packets.front();
+                channel.packets.pop_front();
+                // Dropped here, not lost on the wire
+                channel.first_packet = false;
+                channel.previous_seq = cp->getCHDR().get_seq_num();
+                _lanes.release(cp);
+                realigned |= _channels_aligned;
+            }
+            if (channel.packets.empty() || channel.packets.front()->getTimestamp() != newest) {
+                aligned = false;
+            }
+        }
+        if (aligned) {
+            _channels_aligned = true;
+            return true;
+        }
+    }
+}
+
+size_t chameleon_rx_stream::recv_channels(const buffs_type &buffs, const size_t nsamps_per_buff,
+                                          uhd::rx_metadata_t &metadata, const uint64_t timeout_ms) {
+    if (buffs.size() < _nChans) {
+        THROW_TYPE_ERROR();
+    }
+    for (size_t i = 0; i < _nChans; i++) {
+        if (buffs[i] == nullptr) {
+            THROW_TYPE_ERROR();
+        }
+    }
+
+    std::lock_guard<std::mutex> stream_lock(mtx_stream);
+    size_t n_samples = 0;
+    metadata.reset();
+    while (n_samples < nsamps_per_buff) {
+        bool realigned = false;
+        if (!align_channels(timeout_ms, realigned)) {
+            if (n_samples == 0) {
+                metadata.error_code = uhd::rx_metadata_t::ERROR_CODE_TIMEOUT;
+            }
+            break;
+        }
+
+        const chameleon_packet *first = _channels[0].packets.front();
+        if (first->getPos() == 0) {
+            // A new set of packets
+            if (n_samples == 0) {
+                metadata.has_time_spec = true;
+                metadata.time_spec = uhd::time_spec_t(static_cast<double>(first->getTimestamp()) / 1000000000);
+            }
+            for (channel_state_t &channel: _channels) {
+                if (!check_sequence(channel, channel.packets.front())) {
+                    metadata.out_of_sequence = true;
+                    metadata.error_code = uhd::rx_metadata_t::ERROR_CODE_OVERFLOW;
+                }
+            }
+            if (realigned && metadata.error_code == uhd::rx_metadata_t::ERROR_CODE_NONE) {
+                metadata.error_code = uhd::rx_metadata_t::ERROR_CODE_ALIGNMENT;
+            }
+        } else if (n_samples == 0) {
+            metadata.fragment_offset = first->getPos();
+        }
+
+        size_t n = nsamps_per_buff - n_samples;
+        for (const channel_state_t &channel: _channels) {
+            n = std::min(n, channel.packets.front()->getSamplesLeft());
+        }
+        for (size_t i = 0; i < _nChans; i++) {
+            channel_state_t &channel = _channels[i];
+            chameleon_packet *cp = channel.packets.front();
+            cp->getSamples(static_cast<uint8_t *>(buffs[i]) + (n_samples * _converter.get_bytes_per_sample()), n,
+                           _converter);
+            if (cp->endOfPacket()) {
+                channel.packets.pop_front();
+                _lanes.release(cp);
+            }
+        }
+        n_samples += n;
+    }
+    metadata.more_fragments = !_channels[0].packets.empty() && _channels[0].packets.front()->getPos() > 0;
+    return n_samples;
+}
+
+void chameleon_rx_stream::release_channel_packets() {
+    for (channel_state_t &channel: _channels) {
+        for (chameleon_packet *cp: channel.packets) {
+            _lanes.release(cp);
+        }
+        channel.packets.clear();
+    }
+}
+
+transport::frame_buff::uptr chameleon_rx_stream::get_recv_buff(uhd::rx_metadata_t &metadata, const double timeout) {
+    std::lock_guard<std::mutex> stream_lock(mtx_stream);
+    transport::frame_buff::uptr buff = _recv_link->get_recv_buff(static_cast<int32_t>(timeout * 1000));
+    if (buff) {
+        set_packet_metadata(chameleon_recv_link::get_packet(buff), metadata);
+    } else {
+        metadata.error_code = uhd::rx_metadata_t::ERROR_CODE_TIMEOUT;
+    }
+    return buff;
+}
+
+void chameleon_rx_stream::release_recv_buff(transport::frame_buff::uptr buff) {
+    std::lock_guard<std::mutex> stream_lock(mtx_stream);
+    _recv_link->release_recv_buff(std::move(buff));
+}
+
 size_t chameleon_rx_stream::recv(const buffs_type &buffs, const size_t nsamps_per_buff, uhd::rx_metadata_t &metadata,
                                  const double timeout, const bool one_packet) {
     int err = 0;
     size_t n_samples = 0;
 
-    /* FIXME - do a proper C++ cast here */
-    auto *output_array = static_cast<chameleon_data_type *>(buffs[0]);
+    if (_nChans > 1) {
+        return recv_channels(buffs, nsamps_per_buff, metadata, static_cast<uint64_t>(timeout * 1000));
+    }
+
+    auto *output_array = static_cast<uint8_t *>(buffs[0]);
+    const size_t bytes_per_sample = _converter.get_bytes_per_sample();
     if (output_array == nullptr) {
         THROW_TYPE_ERROR();
     }
 
     while (n_samples < nsamps_per_buff && !err) {
         size_t n = get_packet_data(nsamps_per_buff - n_samples,
-                                   output_array + n_samples,
+                                   output_array + (n_samples * bytes_per_sample),
                                    metadata,
                                    static_cast<uint64_t>(timeout * 1000));
         if (n > 0) {
             n_samples += n;
         } else {
-            fprintf(stderr, "Error getting samples\n");
+            if (timeout > 0.0) {
+                // A zero timeout polls, nothing to receive is the expected outcome
+                rlprintf("Error getting samples\n");
+            }
             err = -1;
         }
     }
@@ -178,47 +596,195 @@ size_t chameleon_rx_stream::recv(const buffs_type &buffs, const size_t nsamps_pe
 
 void chameleon_rx_stream::receive_thread_func(receive_thread_context *rtc) const {
 
-    int socket_fd = open_socket();
-    if (socket_fd < 0) {
-        dbfprintf(stderr, "Error: open socket FAILED");
-    } else {
-        while (rtc->run) {
-            chameleon_packet *cp = nullptr;
-            std::unique_lock<std::mutex> lock_free(*rtc->mtx_free);
-            auto now = std::chrono::system_clock::now();
-            auto then = now + std::chrono::milliseconds(100);
-            bool ret = false;
-            do {
-                ret = rtc->cv_free->wait_until(lock_free, then, [&rtc] { return !rtc->q_free->empty(); });
-            } while (!ret && rtc->run); // While timed out and predicate false and still running
-            if (ret) {
-                // Did not time out and predicate is true
-                cp = rtc->q_free->front();
+    // Before the backend allocates anything, so its memory is local to the pinned CPU
+    set_receive_thread_sched(rtc->lane);
+    if (!begin_receive(rtc, false)) {
+        rlprintf("Error: open receive backend FAILED\n");
+        return;
+    }
+    while (rtc->run) {
+        if (!receive_step(rtc)) {
+            // The consumer has every packet, datagrams wait in (or drop from) the socket buffer meanwhile
+            chameleon_packet *cp = rtc->free_packets->pop_wait(100);
+            if (cp != nullptr) {
+                rtc->batch[rtc->n_batch++] = cp;
+            }
+        }
+    }
+    end_receive(rtc);
+}
+
+bool chameleon_rx_stream::begin_receive(receive_thread_context_t *rtc, const bool non_blocking) const {
+    rtc->backend = open_backend(non_blocking);
+    if (rtc->backend == nullptr) {
+        return false;
+    }
+    rtc->batch.assign(_recv_batch_size, nullptr);
+    rtc->n_batch = 0;
+    rtc->calls = 0;
+    rtc->drops_base = rtc->socket_drops.load(std::memory_order_relaxed);
+    rtc->views.resize(_packet_callback ? _recv_batch_size : 0);
+    return true;
+}
+
+bool chameleon_rx_stream::receive_step(receive_thread_context_t *rtc) const {
+    std::vector<chameleon_packet *> &batch = rtc->batch;
+    size_t &n_batch = rtc->n_batch;
+    const bool drop_newest = (_overflow_policy == ipsolon_rx_stream::stream_type::DROP_NEWEST_OVERFLOW);
+    const bool drop_oldest = (_overflow_policy == ipsolon_rx_stream::stream_type::DROP_OLDEST_OVERFLOW);
+
+    // Top up the batch
+    n_batch += rtc->free_packets->pop_bulk(&batch[n_batch], _recv_batch_size - n_batch);
+    if (n_batch == 0) {
+        rtc->free_starvation.store(rtc->free_starvation.load(std::memory_order_relaxed) + 1,
+                                   std::memory_order_relaxed);
+        return false;
+    }
+
+    int n = rtc->backend->receive(batch.data(), n_batch);
+    if (n > 0) {
+        uint64_t bytes = 0;
+        for (int i = 0; i < n; i++) {
+            bytes += batch[i]->getPacketSize();
+        }
+        // Only this thread writes the counters, no need for atomic read-modify-writes
+        rtc->recv_calls.store(rtc->recv_calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        rtc->packets.store(rtc->packets.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        rtc->bytes.store(rtc->bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+
+        if (!rtc->views.empty()) {
+            for (int i = 0; i < n; i++) {
+                const chameleon_packet *cp = batch[i];
+                rtc->views[i].chdr = cp->getCHDR();
+                rtc->views[i].timestamp = cp->getTimestamp();
+                rtc->views[i].samples = reinterpret_cast<const std::complex<int16_t> *>(cp->getSampleMem());
+                rtc->views[i].nsamps = cp->getNumSamples();
+            }
+            // The batch stays with this thread, the next receive reuses the packets
+            _packet_callback(rtc->views.data(), static_cast<size_t>(n));
+            rtc->backend->reuse(batch.data(), static_cast<size_t>(n));
+        } else {
+            // Delivering the whole batch would leave nothing to receive into
+            const bool starved = (drop_newest || drop_oldest) && static_cast<size_t>(n) == n_batch &&
+                                 rtc->free_packets->empty();
+            if (starved) {
+                rtc->free_starvation.store(rtc->free_starvation.load(std::memory_order_relaxed) + 1,
+                                           std::memory_order_relaxed);
             }
-            lock_free.unlock();
-
-            ssize_t n = 0;
-            while (n == 0 && rtc->run && cp != nullptr) {
-                n = recvfrom(socket_fd, cp->getPacketMem(), cp->getPacketSize(), 0, nullptr, nullptr);
-                if (n > 0) {
-                    lock_free.lock();
-                    rtc->q_free->pop();
-                    lock_free.unlock();
-
-                    std::lock_guard<std::mutex> lock_samples(*rtc->mtx_free);
-                    cp->setPacketSize(n);
-                    rtc->q_samples->push(cp);
-                    rtc->cv_samples->notify_one();
-                } else if (rtc->run) {
-                    if (errno != EAGAIN) {
-                        dbfprintf(stderr, "Receive error. n:%ld errno: %d\n", n, errno);
+            if (starved && drop_newest) {
+                // Receive into the same packets again, the application sees a sequence gap
+                rtc->overflow_drops.store(rtc->overflow_drops.load(std::memory_order_relaxed) + n,
+                                          std::memory_order_relaxed);
+                rtc->backend->reuse(batch.data(), static_cast<size_t>(n));
+            } else {
+                for (int i = 0; i < n; i++) {
+                    rtc->sample_packets->push(batch[i]);
+                }
+                _lanes.notify_ready();
+                const uint64_t depth = rtc->sample_packets->size();
+                if (depth > rtc->queue_high_water.load(std::memory_order_relaxed)) {
+                    rtc->queue_high_water.store(depth, std::memory_order_relaxed);
+                }
+                // Keep the unused packets at the front of the batch
+                std::copy(batch.begin() + n, batch.begin() + n_batch, batch.begin());
+                n_batch -= n;
+
+                if (starved && drop_oldest) {
+                    // Take back the stalest packets the application has not read yet, it sees a sequence gap
+                    size_t stolen = 0;
+                    chameleon_packet *cp;
+                    while (n_batch < _recv_batch_size && (cp = rtc->sample_packets->steal()) != nullptr) {
+                        batch[n_batch++] = cp;
+                        stolen++;
                     }
+                    rtc->overflow_drops.store(rtc->overflow_drops.load(std::memory_order_relaxed) + stolen,
+                                              std::memory_order_relaxed);
                 }
             }
-        } // end while (rtc->run)
-        close(socket_fd);
-    } // end if (socket_fs < 0)
+        }
+    } else if (n < 0 && rtc->run) {
+        rlprintf("Receive error. n:%d errno: %d\n", n, errno);
+    }
+    if (++rtc->calls % DROPS_POLL_CALLS == 0) {
+        rtc->socket_drops.store(rtc->drops_base + rtc->backend->get_drops(), std::memory_order_relaxed);
+    }
+    return true;
+}
 
+void chameleon_rx_stream::end_receive(receive_thread_context_t *rtc) const {
+    rtc->socket_drops.store(rtc->drops_base + rtc->backend->get_drops(), std::memory_order_relaxed);
+    rtc->backend.reset();
+
+    // Only the receiver consumes from the free queue, so stop_stream() returns these once it is stopped
+    rtc->held_packets.assign(rtc->batch.begin(), rtc->batch.begin() + rtc->n_batch);
+    rtc->n_batch = 0;
+}
+
+void chameleon_rx_stream::set_receive_thread_sched(const size_t lane) const {
+    if (_recv_cpu >= 0) {
+        // One CPU per receive thread, starting at RECV_CPU
+        const int cpu = _recv_cpu + static_cast<int>(lane);
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (err) {
+            rlprintf("Receive thread CPU %d affinity error: %s\n", cpu, strerror(err));
+        }
+    } else if (_numa_node >= 0) {
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(_numa_cpus), &_numa_cpus);
+        if (err) {
+            rlprintf("Receive thread NUMA node %d affinity error: %s\n", _numa_node, strerror(err));
+        }
+    }
+    if (_recv_priority > 0) {
+        sched_param param{};
+        param.sched_priority = _recv_priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err) {
+            // Needs CAP_SYS_NICE or an RLIMIT_RTPRIO of at least _recv_priority
+            rlprintf("Receive thread SCHED_FIFO %d error: %s\n", _recv_priority, strerror(err));
+        }
+    }
+}
+
+chameleon_rx_backend::uptr chameleon_rx_stream::open_backend(const bool non_blocking) const {
+    // Spinning backends are polled with a zero timeout
+    const bool spin = _recv_spin || non_blocking;
+    const timeval timeout = spin ? timeval{0, 0} : _vita_port_timeout;
+    int socket_fd = open_socket();
+    if (_recv_backend == ipsolon_rx_stream::stream_type::AF_PACKET_BACKEND) {
+        // The UDP socket stays bound (but unread) so the datagrams are not answered with port unreachable
+        std::unique_ptr<chameleon_af_packet_rx> af_packet(
+            new chameleon_af_packet_rx(_vita_ip, _vita_port, timeout, socket_fd));
+        if (_recv_threads > 1) {
+            // Every packet socket sees every datagram, a fanout group spreads them over the threads instead
+            af_packet->set_fanout(_vita_port, (_recv_steering == ipsolon_rx_stream::stream_type::HASH_STEERING)
+                                                  ? PACKET_FANOUT_HASH
+                                                  : PACKET_FANOUT_LB);
+        }
+        if (!af_packet->open()) {
+            return nullptr;
+        }
+        return chameleon_rx_backend::uptr(af_packet.release());
+    }
+    if (socket_fd < 0) {
+        return nullptr;
+    }
+    if (_recv_backend == ipsolon_rx_stream::stream_type::URING_BACKEND) {
+        std::unique_ptr<chameleon_uring_rx> uring(new chameleon_uring_rx(socket_fd, _recv_batch_size, timeout));
+        if (uring->open()) {
+            return chameleon_rx_backend::uptr(uring.release());
+        }
+        // Old kernel or io_uring disabled, the failed backend took the socket with it
+        fprintf(stderr, "io_uring receive not available, using recvmmsg\n");
+        uring.reset();
+        socket_fd = open_socket();
+        if (socket_fd < 0) {
+            return nullptr;
+        }
+    }
+    return chameleon_rx_backend::uptr(new chameleon_socket_rx(socket_fd, _recv_batch_size, spin));
 }
 
 void chameleon_rx_stream::issue_stream_cmd(const uhd::stream_cmd_t &stream_cmd) {
@@ -236,58 +802,83 @@ void chameleon_rx_stream::issue_stream_cmd(const uhd::stream_cmd_t &stream_cmd)
 
 void chameleon_rx_stream::config_stream() {
     // Issue stream_rx_cfg - returns Stream id
-    std::unique_ptr<chameleon_fw_cmd>
-            stream_rx_cfg(new chameleon_fw_stream_rx_cfg(_chanMask, _vita_ip_str, _vita_port));
-    chameleon_fw_comms stream_rx_cfg_request(std::move(stream_rx_cfg));
-    _commander.send_request(stream_rx_cfg_request);
+    chameleon_fw_comms stream_rx_cfg_request{chameleon_fw_stream_rx_cfg(_chanMask, _vita_ip_str.c_str(), _vita_port)};
+    _commander->send_request(stream_rx_cfg_request);
     // Get stream id from response
-    _stream_id = 0;
-    for (const auto &resp_parm: stream_rx_cfg_request.getResponse()) {
-       size_t id_indx = resp_parm.find("id=");
-       if (id_indx != std::string::npos) {
-          std::string id_str = resp_parm.substr(id_indx + 3);
-          _stream_id = std::stoul(id_str);
-        }
-    }
+    uint64_t id = 0;
+    _stream_id = chameleon_fw_stream_rx_cfg::decode(stream_rx_cfg_request, id) ? static_cast<uint32_t>(id) : 0;
 }
 
 
 void chameleon_rx_stream::start_stream() {
-    _first_packet = true;
-    _receive_thread_context.run = true;
-    _recv_thread = std::thread([=] { receive_thread_func(&_receive_thread_context); });
+    for (channel_state_t &channel: _channels) {
+        channel.first_packet = true;
+    }
+    _channels_aligned = false;
+    for (std::unique_ptr<receive_thread_context_t> &rtc: _receive_threads) {
+        receive_thread_context_t *context = rtc.get();
+        context->run = true;
+        if (!_reactor) {
+            context->thread = std::thread([this, context] { receive_thread_func(context); });
+        } else if (begin_receive(context, true)) {
+            context->reactor_id = _reactor->add(context->backend->get_fd(),
+                                                [this, context] { return receive_step(context); },
+                                                [context] { return !context->free_packets->empty(); });
+        } else {
+            fprintf(stderr, "Error: open receive backend FAILED\n");
+        }
+    }
 
     send_rx_cfg_set_cmd(_chanMask);
 
     dbprintf("chameleon_rx_stream start stream _stream_id = %d\n",_stream_id);
     // Issue stream_start command
     if (_stream_id) {
-        std::unique_ptr<chameleon_fw_cmd> stream_start(new chameleon_fw_stream_start(_stream_id));
-        chameleon_fw_comms stream_start_request(std::move(stream_start));
-        _commander.send_request(stream_start_request);
+        chameleon_fw_comms stream_start_request{chameleon_fw_stream_start(_stream_id)};
+        _commander->send_request(stream_start_request);
     }
 }
 
 void chameleon_rx_stream::stop_stream() {
-    if (_receive_thread_context.run) {
-        _receive_thread_context.run = false;
+    if (_receive_threads[0]->run) {
+        for (std::unique_ptr<receive_thread_context_t> &rtc: _receive_threads) {
+            rtc->run = false;
+        }
 
         dbprintf("stop_stream stream_id=%d",_stream_id);
-        std::unique_ptr<chameleon_fw_cmd> stream_stop_cmd(
-            new chameleon_fw_stream_stop(_stream_id));
-        chameleon_fw_comms request(std::move(stream_stop_cmd));
+        chameleon_fw_comms request{chameleon_fw_stream_stop(_stream_id)};
         // The response takes a LONG time so set timeout to 30 seconds
-        _commander.send_request(request, 30000);
-
-        _recv_thread.join();
-        _current_packet = nullptr;
+        _commander->send_request(request, 30000);
+
+        _lanes.wake();
+        for (std::unique_ptr<receive_thread_context_t> &rtc: _receive_threads) {
+            if (!_reactor) {
+                rtc->thread.join();
+            } else if (rtc->backend != nullptr) {
+                // Returns once no reactor thread is in (or will enter) the receiver, no timeout to wait out
+                _reactor->remove(rtc->reactor_id);
+                end_receive(rtc.get());
+            }
+        }
 
-        std::lock_guard<std::mutex> free_lock(mtx_free_queue);
-        std::lock_guard<std::mutex> sample_lock(mtx_sample_queue);
-        while (!q_sample_packets.empty()) {
-            q_free_packets.push(q_sample_packets.front());
-            q_sample_packets.pop();
+        // The receivers are stopped, so this thread may act as both producer and consumer
+        std::lock_guard<std::mutex> stream_lock(mtx_stream);
+        for (std::unique_ptr<receive_thread_context_t> &rtc: _receive_threads) {
+            for (chameleon_packet *cp: rtc->held_packets) {
+                rtc->free_packets->push(cp);
+            }
+            rtc->held_packets.clear();
         }
+        if (_current_packet != nullptr) {
+            _lanes.release(_current_packet);
+            _current_packet = nullptr;
+        }
+        release_channel_packets();
+        _lanes.drain();
+    }
+    ready_callback_t waiter = _lanes.cancel_ready_waiter();
+    if (waiter) {
+        waiter(false);
     }
 }
 
@@ -315,6 +906,14 @@ int chameleon_rx_stream::open_socket() const {
             perror("Socket SO_REUSEADDR set error");
         }
     }
+    if (!err && _recv_threads > 1) {
+        // Every receive thread binds its own socket to the VITA port
+        int reuse = 1;
+        err = setsockopt(sock_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+        if (err < 0) {
+            perror("Socket SO_REUSEPORT set error");
+        }
+    }
     if (!err) {
         sockaddr_in local_addr{};
         local_addr.sin_family = AF_INET;
@@ -325,18 +924,46 @@ int chameleon_rx_stream::open_socket() const {
             perror("bind failed");
         }
     }
+    if (!err && _recv_threads > 1 && _recv_steering == ipsolon_rx_stream::stream_type::SEQ_STEERING) {
+        attach_steering_filter(sock_fd);
+    }
     if (!err) {
         err = setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, &_vita_port_timeout, sizeof(_vita_port_timeout));
         if (err < 0) {
             perror("Socket timeout set error");
         }
     }
-    if (!err) {
-        int optval = (48*1024*1024);
-        err = setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &optval, sizeof(optval));
+    if (!err && _busy_poll_usec > 0) {
+        // Let the receive thread poll the NIC queue instead of waiting for its interrupt
+        err = setsockopt(sock_fd, SOL_SOCKET, SO_BUSY_POLL, &_busy_poll_usec, sizeof(_busy_poll_usec));
         if (err < 0) {
-            perror("Socket rx buffer set error");
+            perror("Socket SO_BUSY_POLL set error (needs CAP_NET_ADMIN)");
         }
+#ifdef SO_PREFER_BUSY_POLL
+        if (!err) {
+            int prefer = 1;
+            if (setsockopt(sock_fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) < 0) {
+                dbfprintf(stderr, "SO_PREFER_BUSY_POLL not supported\n");
+            }
+        }
+#endif
+    }
+    // An AF_PACKET backend reads its own ring and shrinks the socket's buffer, a warning about it would not apply
+    if (!err && _recv_backend != ipsolon_rx_stream::stream_type::AF_PACKET_BACKEND) {
+        size_t granted = transport::resize_udp_socket_buffer_with_warning(
+            [sock_fd](size_t size) {
+                int optval = static_cast<int>(std::min<size_t>(size, INT_MAX / 2));
+                if (setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &optval, sizeof(optval)) < 0) {
+                    perror("Socket rx buffer set error");
+                }
+                optval = 0;
+                socklen_t len = sizeof(optval);
+                getsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &optval, &len);
+                // The kernel doubles the value asked for to account for its bookkeeping
+                return static_cast<size_t>(optval) / 2;
+            },
+            _socket_buffer_size, "recv");
+        _socket_buffer_granted.store(granted, std::memory_order_relaxed);
     }
     if (err) {
         if (sock_fd > -1) {
@@ -346,3 +973,21 @@ int chameleon_rx_stream::open_socket() const {
     }
     return sock_fd;;
 }
+
+void chameleon_rx_stream::attach_steering_filter(const int sock_fd) const {
+    // The program sees the UDP payload and returns the index of the socket in the SO_REUSEPORT group.
+    // The CHDR header is little endian with the sequence number in bits 32-47, so byte 4 is its low byte:
+    // consecutive packets of a channel go round robin over the sockets, whichever order they joined in.
+    sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 4),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(_recv_threads)),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    sock_fprog prog{};
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    // The group shares one program, attaching it again from each socket just replaces it
+    if (setsockopt(sock_fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) < 0) {
+        perror("SO_ATTACH_REUSEPORT_CBPF failed, datagrams are steered by flow hash");
+    }
+}
@@ -9,16 +9,22 @@
 #define CHAMELEON_STREAM_HPP
 #include <thread>
 #include <chameleon_fw_commander.hpp>
-#include <queue>
 #include <mutex>
-#include <condition_variable>
+#include <atomic>
+#include <array>
+#include <deque>
+#include <vector>
 #include <netinet/in.h>
+#include <sched.h>
 
 #include "ipsolon_rx_stream.hpp"
 #include "ipsolon_chdr_header.h"
-
-// FIXME
-#define DEFAULT_BUFFER_SIZE (4 * 1024 * 1024)
+#include "chameleon_packet_lanes.hpp"
+#include "chameleon_packet_pool.hpp"
+#include "chameleon_recv_link.hpp"
+#include "chameleon_rx_backend.hpp"
+#include "chameleon_converter.hpp"
+#include "chameleon_rx_reactor.hpp"
 
 namespace ihd {
     class chameleon_packet;
@@ -40,16 +46,37 @@ namespace ihd {
 
         void issue_stream_cmd(const uhd::stream_cmd_t &stream_cmd) override;
 
+        [[nodiscard]] stream_stats_t get_stats() const override;
+
+        int get_ready_fd() override;
+
+        void async_wait_ready(ready_callback_t callback) override;
+
+        void set_packet_callback(packet_callback_t callback) override;
+
+        transport::frame_buff::uptr get_recv_buff(uhd::rx_metadata_t &metadata, double timeout) override;
+
+        void release_recv_buff(transport::frame_buff::uptr buff) override;
+
     protected:
         virtual void send_rx_cfg_set_cmd(const uint32_t chanMask) = 0;
 
-        std::queue<chameleon_packet *> q_free_packets;
-        std::mutex mtx_free_queue;
+        /*!
+         * Size and allocate the packet pool, size the packet rings to match and fill the free rings.
+         * Called by the stream type constructors once the packet size is known.
+         * The pool holds BUFFER_TIME_KEY of packets at SAMPLE_RATE_KEY, capped by BUFFER_BYTES_KEY,
+         * or default_packet_cnt packets when neither is given. The socket buffers follow the pool.
+         * The UHD link args num_recv_frames, recv_frame_size and recv_buff_size (device or stream level,
+         * see calculate_udp_link_params()) override the packet count, frame size and socket buffer size.
+         * \param bytes_per_packet the largest datagram, CHDR header included
+         * \param default_packet_cnt the pool size of the stream type
+         */
+        void init_packet_queues(size_t bytes_per_packet, size_t default_packet_cnt);
 
         stream_type _stream_type;
         size_t _max_samples_per_packet;
         size_t _buffer_packet_cnt;
-        chameleon_fw_commander _commander;
+        chameleon_fw_commander::sptr _commander;
         uint32_t _chanMask{};
 
     private:
@@ -57,50 +84,116 @@ namespace ihd {
         static constexpr uint32_t DEFAULT_VITA_IP = INADDR_ANY;
         static constexpr uint32_t DEFAULT_VITA_PORT = 9090;
         static constexpr size_t DEFAULT_TIMEOUT_USEC = 250000;
+        static constexpr size_t DEFAULT_RECV_BATCH = 1;
+        static constexpr size_t MAX_RECV_BATCH = 1024; /* UIO_MAXIOV */
+        static constexpr size_t MAX_RECV_THREADS = 16;
+        static constexpr size_t MAX_REACTOR_THREADS = 64;
+        static constexpr uint64_t DROPS_POLL_CALLS = 256; /* Receive loops between reads of the socket drop counter */
+        static constexpr size_t DEFAULT_SOCKET_BUFFER_SIZE = 48 * 1024 * 1024; /* SO_RCVBUF without a buffer arg */
 
         std::string _vita_ip_str;
         in_addr_t _vita_ip;
         uint16_t _vita_port;
         uint32_t _stream_id{};
+        size_t _recv_batch_size; /* Max packets filled by a single recvmmsg() */
+        bool _huge_pages{};
+        std::string _recv_backend; /* One of the stream_type backends */
+        int _recv_cpu{-1};          /* CPU the receive thread is pinned to, -1 to let it float */
+        int _recv_priority{};       /* SCHED_FIFO priority of the receive thread, 0 for the default policy */
+        int _busy_poll_usec{};      /* SO_BUSY_POLL on the VITA socket, 0 for none */
+        bool _recv_spin{};          /* Never block in the backend, poll it in a loop */
+        size_t _recv_threads{1};    /* Receive threads, each with its own socket on the VITA port */
+        size_t _reactor_threads{};  /* Threads of the shared reactor, 0 for the stream's own receive threads */
+        std::string _recv_steering; /* SEQ_STEERING or HASH_STEERING */
+        std::string _overflow_policy; /* BLOCK_OVERFLOW, DROP_NEWEST_OVERFLOW or DROP_OLDEST_OVERFLOW */
         static constexpr uint32_t DEFAULT_PACKET_SIZE = 8192;
 
-        size_t _buffer_mem_size = (DEFAULT_BUFFER_SIZE); /* The memory allocated to store received UDP packets */
+        double _sample_rate{};     /* Expected samples per second per channel, 0 if unknown */
+        double _buffer_time_ms{};  /* Buffering asked for, 0 for none */
+        size_t _buffer_bytes{};    /* Pool memory budget, 0 for none */
+        size_t _socket_buffer_size{DEFAULT_SOCKET_BUFFER_SIZE}; /* SO_RCVBUF asked for on each receive socket */
+        mutable std::atomic<uint64_t> _socket_buffer_granted{0}; /* SO_RCVBUF the kernel gave the last socket */
+        int _numa_node{-1};  /* Node of the packet pool and receive threads, -1 for none */
+        cpu_set_t _numa_cpus{}; /* CPUs of _numa_node, the receive threads run on them unless RECV_CPU is given */
+        uhd::device_addr_t _device_args; /* Device and stream level link args (num_recv_frames, recv_buff_size ..) */
+        uhd::device_addr_t _stream_args;
 
         timeval _vita_port_timeout = {0, DEFAULT_TIMEOUT_USEC};
 
-        /* Free Queue and Sample Queue
-        * Receiver: Take from free queue, receive message, place in sample queue.
-        *           When free is empty, steal from samples queue.
-        * Consumer: Take from sample queue, process samples, place in free queue when done
+        /* Free Queue and Sample Queue, one pair per receive thread
+        * Receiver: Take up to a batch of packets from free queue, receive messages, place in sample queue.
+        *           When free is empty, block or drop packets depending on the overflow policy.
+        * Consumer: Take from sample queues (in sequence order), process samples, place in free queue when done
+        * Each queue is a lock-free SPSC ring, both are sized to hold every packet so a push never fails.
         */
-        std::condition_variable cv_free_queue;
-        std::queue<chameleon_packet *> q_sample_packets;
-        std::mutex mtx_sample_queue;
-        std::condition_variable cv_sample_queue;
+        chameleon_packet_lanes _lanes;
+        std::unique_ptr<chameleon_packet_pool> _packet_pool;
+        std::unique_ptr<chameleon_recv_link> _recv_link;
 
         std::mutex mtx_stream;
 
         size_t _nChans{};
 
+        /* Per channel receive state, in the order of stream_args.channels (and of the recv() buffs) */
+        typedef struct channel_state {
+            /* Packets demultiplexed to this channel and not consumed yet, the front one is being read.
+             * Only used by multi-channel streams, a single channel stream reads _current_packet. */
+            std::deque<chameleon_packet *> packets;
+            bool first_packet{};
+            /** Last sequence number received - compare to current to detect missing packets */
+            uint16_t previous_seq{};
+        } channel_state_t;
+
+        static constexpr size_t MAX_VC = 64; /* CHDR virtual channel is 6 bits */
+        static constexpr int8_t NO_CHANNEL = -1;
+
+        std::vector<channel_state_t> _channels;
+        /* CHDR virtual channel (0 based channel number) -> index in _channels */
+        std::array<int8_t, MAX_VC> _vc_to_channel{};
+        bool _channels_aligned{}; /* Multi-channel: the channels have been time aligned since start_stream() */
+
         chameleon_packet *_current_packet;
-        bool _first_packet{};
-        /** Last sequence number received - compare to current to detect missing packets */
-        uint16_t _previous_seq{};
 
-        typedef struct receive_thread_context {
-            bool run;
+        chameleon_converter _converter; /* Packet payload (sc16) to the stream's cpu_format */
 
-            std::queue<chameleon_packet *> *q_free;
-            std::mutex *mtx_free;
-            std::condition_variable *cv_free;
+        packet_callback_t _packet_callback; /* Receive threads deliver to this instead of the sample queues */
 
-            std::queue<chameleon_packet *> *q_samples;
-            std::mutex *mtx_samples;
-            std::condition_variable *cv_samples;
+        /* A receiver: one socket and one lane, served by its own thread or by the reactor */
+        typedef struct receive_thread_context {
+            std::atomic<bool> run;
+            size_t lane; /* Index of the thread and of its rings in _lanes */
+
+            chameleon_packet_ring *free_packets;
+            chameleon_packet_ring *sample_packets;
+            std::vector<chameleon_packet *> held_packets; /* Free packets the thread had when it exited */
+
+            /* Receive state, used by one thread at a time between begin_receive() and end_receive() */
+            chameleon_rx_backend::uptr backend;
+            std::vector<chameleon_packet *> batch; /* Free packets to receive into, the first n_batch are valid */
+            size_t n_batch;
+            uint64_t calls;
+            uint64_t drops_base; /* socket_drops of the earlier runs */
+            std::vector<packet_view_t> views; /* Packet callback argument */
+            uint64_t reactor_id;
+
+            /* Statistics, written by the receive thread only */
+            std::atomic<uint64_t> packets;
+            std::atomic<uint64_t> recv_calls;
+            std::atomic<uint64_t> bytes;
+            std::atomic<uint64_t> free_starvation;
+            std::atomic<uint64_t> queue_high_water;
+            std::atomic<uint64_t> socket_drops;
+            std::atomic<uint64_t> overflow_drops;
+
+            std::thread thread;
         } receive_thread_context_t;
 
-        receive_thread_context_t _receive_thread_context;
-        std::thread _recv_thread;
+        std::vector<std::unique_ptr<receive_thread_context_t>> _receive_threads;
+        chameleon_rx_reactor::sptr _reactor; /* Serves the receivers instead of their threads, if set */
+
+        /* Statistics of the consumer side, written with the stream lock held and read without it */
+        std::atomic<uint64_t> _dropped_packets{0};
+        std::atomic<uint64_t> _reorder_events{0};
 
         void start_stream();
 
@@ -110,9 +203,71 @@ namespace ihd {
 
         int open_socket() const;
 
+        /*!
+         * Spread the datagrams of the VITA port over the receive thread sockets by CHDR sequence number
+         */
+        void attach_steering_filter(int sock_fd) const;
+
+        /*!
+         * Open the receive backend selected by the stream args
+         * \param non_blocking receive() returns at once when nothing is queued (as with RECV_SPIN)
+         * \return the backend, nullptr on failure
+         */
+        chameleon_rx_backend::uptr open_backend(bool non_blocking) const;
+
         void receive_thread_func(receive_thread_context_t *rtc) const;
 
-        size_t get_packet_data(size_t n, chameleon_data_type *buff, uhd::rx_metadata_t &metadata, uint64_t timeout_ms);
+        /*!
+         * Open rtc's backend and reset its receive state
+         * \return false if the backend could not be opened
+         */
+        bool begin_receive(receive_thread_context_t *rtc, bool non_blocking) const;
+
+        /*!
+         * Receive one batch and deliver it
+         * \return false if there was no free packet to receive into
+         */
+        bool receive_step(receive_thread_context_t *rtc) const;
+
+        /*! Close rtc's backend and keep its free packets in held_packets */
+        void end_receive(receive_thread_context_t *rtc) const;
+
+        /*!
+         * Apply the CPU affinity and real time priority from the stream args to the calling thread
+         * \param lane receive thread number, pinned to the CPU lane places after RECV_CPU.
+         *             Without RECV_CPU every thread may run on any CPU of the NUMA node.
+         */
+        void set_receive_thread_sched(size_t lane) const;
+
+        size_t get_packet_data(size_t n, void *buff, uhd::rx_metadata_t &metadata, uint64_t timeout_ms);
+
+        void set_packet_metadata(const chameleon_packet *cp, uhd::rx_metadata_t &metadata);
+
+        /*!
+         * Check cp's sequence number against the previous packet of its channel and count the missing ones
+         * \return false if packets are missing or cp is older than the previous packet
+         */
+        bool check_sequence(channel_state_t &channel, const chameleon_packet *cp);
+
+        /*! Receive state of the channel cp belongs to, nullptr if it is not one of the stream's channels */
+        channel_state_t *get_channel(const chameleon_packet *cp);
+
+        /*!
+         * recv() for a multi-channel stream: packets are classified by CHDR virtual channel (channel number - 1)
+         * and buffs[i] gets the time aligned samples of stream_args.channels[i]
+         */
+        size_t recv_channels(const buffs_type &buffs, size_t nsamps_per_buff, uhd::rx_metadata_t &metadata,
+                             uint64_t timeout_ms);
+
+        /*!
+         * Demultiplex received packets until every channel has one, then drop packets until the
+         * front packets of all channels have the same timestamp.
+         * \param realigned set when packets had to be dropped after the channels were first aligned
+         * \return false on timeout
+         */
+        bool align_channels(uint64_t timeout_ms, bool &realigned);
+
+        void release_channel_packets();
     };
 } // ihd
 
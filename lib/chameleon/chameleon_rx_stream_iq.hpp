@@ -29,10 +29,10 @@ namespace ihd {
     private:
         static constexpr uint32_t PACKET_HEADER_SIZE = 16;
         static constexpr uint32_t DEFAULT_PACKET_SIZE = 8192 + PACKET_HEADER_SIZE;
+        /* Without BUFFER_TIME_KEY/BUFFER_BYTES_KEY the pool has this / samples per packet packets */
         static constexpr uint32_t DEFAULT_IQ_BUFFER_MEM_SIZE = 0x28C58000;
         size_t _packet_size;
         size_t _bytes_per_packet = DEFAULT_PACKET_SIZE;
-        size_t _buffer_mem_size = DEFAULT_IQ_BUFFER_MEM_SIZE;
 
         timeval _vita_port_timeout = {0, DEFAULT_USEC_TIMEOUT};
 
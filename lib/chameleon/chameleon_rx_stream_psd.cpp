@@ -14,9 +14,6 @@
 #include "chameleon_packet.hpp"
 using namespace ihd;
 
-//FIXME - need to figure out buffer sizes
-#define PSD_STREAM_BUFFER_SIZE  (4 * 1024 * 1024)
-
 chameleon_rx_stream_psd::chameleon_rx_stream_psd(const uhd::stream_args_t &stream_cmd,
                                          const uhd::device_addr_t &device_addr) :
                         chameleon_rx_stream(stream_cmd, device_addr)
@@ -36,36 +33,30 @@ chameleon_rx_stream_psd::chameleon_rx_stream_psd(const uhd::stream_args_t &strea
         _fft_avg = DEFAULT_FFT_AVG;
     }
     _bytes_per_packet = (_fft_size * BYTES_PER_IQ_PAIR) + PACKET_HEADER_SIZE;
-    // FIXME - fix buffering? Need to speed up udp
-    _buffer_mem_size = (PSD_STREAM_BUFFER_SIZE); /* The memory allocated to store received UDP packets */
-
     _max_samples_per_packet = (_bytes_per_packet - PACKET_HEADER_SIZE) / BYTES_PER_IQ_PAIR;
-    _buffer_packet_cnt = _buffer_mem_size / _max_samples_per_packet;
 
     /* Fill the free queue */
-    std::lock_guard<std::mutex> lock(mtx_free_queue);
-    for (int i = 0; i < _buffer_packet_cnt; ++i) {
-        auto cp = new chameleon_packet(_bytes_per_packet);
-        q_free_packets.push(cp);
-    }
+    init_packet_queues(_bytes_per_packet, DEFAULT_PSD_BUFFER_MEM_SIZE / _max_samples_per_packet);
 
     send_rx_cfg_set_cmd(_chanMask);
 
 }
 
 void chameleon_rx_stream_psd::send_rx_cfg_set_cmd(const uint32_t chanMask) {
+    std::vector<std::unique_ptr<chameleon_fw_comms>> rx_cfg_sets;
+    std::vector<chameleon_fw_comms *> requests;
     size_t chan_num = 1;
     for (int i = 0; i < MAX_RX_CHANNELS; i++) {
         size_t chan_enabled = chanMask & (1 << i);
         if (chan_enabled) {
-            std::unique_ptr<chameleon_fw_cmd> rx_cfg_set_cmd(new chameleon_fw_rx_cfg_set(chan_num,
-                                                             ipsolon_rx_stream::stream_type::PSD_STREAM,
-                                                            _fft_size,
-                                                            _fft_avg));
-            chameleon_fw_comms chameleon_fw_rx_cfg_set(std::move(rx_cfg_set_cmd));
-            _commander.send_request(chameleon_fw_rx_cfg_set);
+            rx_cfg_sets.emplace_back(new chameleon_fw_comms(chameleon_fw_rx_cfg_set_psd(
+                    chan_num, ipsolon_rx_stream::stream_type::PSD_STREAM.c_str(), _fft_size,
+                    static_cast<uint8_t>(_fft_avg))));
+            requests.push_back(rx_cfg_sets.back().get());
         }
         ++chan_num;
     }
+    // All channels in one round trip
+    _commander->send_requests(requests);
 }
 
@@ -10,9 +10,6 @@
 
 #include "chameleon_rx_stream.hpp"
 
-//FIXME - need to figure out buffer sizes
-#define PSD_STREAM_BUFFER_SIZE  (4 * 1024 * 1024)
-
 namespace ihd {
     class chameleon_packet;
 
@@ -31,6 +28,8 @@ namespace ihd {
         static constexpr uint32_t DEFAULT_PACKET_SIZE = 8192;
         static constexpr uint32_t DEFAULT_FFT_SIZE = 256;
         static constexpr uint32_t DEFAULT_FFT_AVG = 120;
+        /* Without BUFFER_TIME_KEY/BUFFER_BYTES_KEY the pool has this / samples per packet packets, 16384 by default */
+        static constexpr size_t DEFAULT_PSD_BUFFER_MEM_SIZE = 4 * 1024 * 1024;
 
         uint32_t _fft_size;
         uint32_t _fft_avg;
@@ -38,10 +37,6 @@ namespace ihd {
         size_t _max_samples_per_packet;
 
         size_t _bytes_per_packet = DEFAULT_PACKET_SIZE;
-        // FIXME - fix buffering? Need to speed up udp
-        size_t _buffer_mem_size{PSD_STREAM_BUFFER_SIZE}; /* The memory allocated to store received UDP packets */
-
-        size_t _buffer_packet_cnt{0};
 
         timeval _vita_port_timeout = {DEFAULT_PSD_TIMEOUT, 0};
 
@@ -0,0 +1,74 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#include "chameleon_socket_rx.hpp"
+#include "chameleon_packet.hpp"
+
+using namespace ihd;
+
+chameleon_socket_rx::chameleon_socket_rx(int socket_fd, size_t max_batch, bool spin) :
+    _socket_fd(socket_fd),
+    _flags(spin ? MSG_DONTWAIT : MSG_WAITFORONE),
+    _msgs(max_batch),
+    _iovs(max_batch),
+    _senders(max_batch),
+    _control((max_batch * CONTROL_SIZE + sizeof(cmsghdr) - 1) / sizeof(cmsghdr)) {
+    int ovfl = 1;
+    if (setsockopt(_socket_fd, SOL_SOCKET, SO_RXQ_OVFL, &ovfl, sizeof(ovfl)) < 0) {
+        perror("Socket SO_RXQ_OVFL set error");
+    }
+}
+
+chameleon_socket_rx::~chameleon_socket_rx() {
+    close(_socket_fd);
+}
+
+int chameleon_socket_rx::receive(chameleon_packet **packets, size_t n) {
+    n = std::min(n, _msgs.size());
+    for (size_t i = 0; i < n; i++) {
+        _iovs[i].iov_base = packets[i]->getPacketMem();
+        _iovs[i].iov_len = packets[i]->getBufferSize();
+        _msgs[i] = {};
+        _msgs[i].msg_hdr.msg_iov = &_iovs[i];
+        _msgs[i].msg_hdr.msg_iovlen = 1;
+        _msgs[i].msg_hdr.msg_name = &_senders[i];
+        _msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        _msgs[i].msg_hdr.msg_control = reinterpret_cast<uint8_t *>(_control.data()) + (i * CONTROL_SIZE);
+        _msgs[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+    }
+    // Block (up to SO_RCVTIMEO, unless spinning) for the first datagram, then take whatever else is already queued
+    int received = recvmmsg(_socket_fd, _msgs.data(), n, _flags, nullptr);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        received = 0; // Timeout
+    }
+    int filled = 0;
+    for (int i = 0; i < received; i++) {
+        if (_msgs[i].msg_len < ipsolon_rx_stream::PACKET_HEADER_SIZE) {
+            continue; // No room for the CHDR header and timestamp, the packet stays free
+        }
+        packets[i]->setPacketSize(_msgs[i].msg_len);
+        packets[i]->setSource(_senders[i].sin_addr.s_addr);
+        std::swap(packets[filled++], packets[i]);
+    }
+    if (received > 0) {
+        // The counter is the socket's running total, the newest datagram has the latest value
+        msghdr &hdr = _msgs[received - 1].msg_hdr;
+        for (cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+                uint32_t drops;
+                memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+                _drops = drops;
+            }
+        }
+    }
+    return (received < 0) ? received : filled;
+}
@@ -0,0 +1,51 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_SOCKET_RX_HPP
+#define CHAMELEON_SOCKET_RX_HPP
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "chameleon_rx_backend.hpp"
+
+namespace ihd {
+    /*!
+     * UDP socket backend, batches datagrams with recvmmsg().
+     * The socket's drop counter comes along with the datagrams (SO_RXQ_OVFL), get_drops() makes no system call
+     * and is up to date as of the newest datagram received.
+     */
+    class chameleon_socket_rx : public chameleon_rx_backend {
+    public:
+        /*!
+         * \param socket_fd bound UDP socket with SO_RCVTIMEO set, closed by the destructor
+         * \param max_batch largest n passed to receive()
+         * \param spin never block, receive() returns 0 at once when nothing is queued
+         */
+        chameleon_socket_rx(int socket_fd, size_t max_batch, bool spin);
+
+        ~chameleon_socket_rx() override;
+
+        int receive(chameleon_packet **packets, size_t n) override;
+
+        uint64_t get_drops() override { return _drops; }
+
+        [[nodiscard]] int get_fd() const override { return _socket_fd; }
+
+    private:
+        static constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(uint32_t)); /* SO_RXQ_OVFL per datagram */
+
+        int _socket_fd;
+        int _flags; /* recvmmsg() flags */
+        std::vector<mmsghdr> _msgs;
+        std::vector<iovec> _iovs;
+        std::vector<sockaddr_in> _senders;
+        std::vector<cmsghdr> _control; /* CONTROL_SIZE bytes per message, cmsghdr for the alignment */
+        uint64_t _drops{};
+    };
+} // ihd
+
+#endif //CHAMELEON_SOCKET_RX_HPP
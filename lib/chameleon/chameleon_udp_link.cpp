@@ -0,0 +1,93 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <sys/socket.h>
+
+#include "chameleon_udp_link.hpp"
+#include "chameleon_packet.hpp"
+#include "debug.hpp"
+
+using namespace ihd;
+
+chameleon_udp_link::sptr chameleon_udp_link::make(const std::string &addr, const std::string &port,
+                                                  const transport::link_params_t &params) {
+    // The free rings are cache line aligned, see make_aligned()
+    return sptr(make_aligned<chameleon_udp_link>(addr, port, params));
+}
+
+chameleon_udp_link::chameleon_udp_link(const std::string &addr, const std::string &port,
+                                       const transport::link_params_t &params) :
+    _params(params),
+    _socket(transport::open_udp_socket(addr, port, _io_service)),
+    _sock_fd(_socket->native_handle()) {
+    const size_t frame_cnt = _params.num_send_frames;
+    if (frame_cnt == 0) {
+        THROW_VALUE_NOT_SUPPORTED_ERROR(std::to_string(frame_cnt));
+    }
+
+    _send_buff_size = transport::resize_udp_socket_buffer_with_warning(
+        [this](size_t size) {
+            return transport::resize_udp_socket_buffer<boost::asio::socket_base::send_buffer_size>(_socket, size);
+        },
+        _params.send_buff_size, "send");
+
+    _pool.reset(new chameleon_packet_pool(frame_cnt, _params.send_frame_size, false));
+    _frames.reserve(frame_cnt);
+    for (size_t i = 0; i < frame_cnt; i++) {
+        _frames.emplace_back(_pool->get_buffer(i));
+    }
+    _free_send_frames.reset(frame_cnt);
+    for (size_t i = 0; i < frame_cnt; i++) {
+        _free_send_frames.push(_pool->get(i));
+    }
+    dbprintf("udp link %s:%s send: %zu x %zu bytes\n", addr.c_str(), port.c_str(), frame_cnt,
+             _params.send_frame_size);
+}
+
+transport::frame_buff::uptr chameleon_udp_link::get_send_buff(int32_t) {
+    // Frames are sent and returned by release_send_buff(), so there is nothing to wait for
+    chameleon_packet *cp = _free_send_frames.pop();
+    if (cp == nullptr) {
+        return transport::frame_buff::uptr();
+    }
+    transport::frame_buff::uptr buff = get_frame(cp);
+    buff->set_packet_size(0);
+    return buff;
+}
+
+void chameleon_udp_link::release_send_buff(transport::frame_buff::uptr buff) {
+    chameleon_packet *cp = get_packet(buff);
+    if (cp == nullptr) {
+        return;
+    }
+    // Back on the free ring once sent, also when send_udp_packet() throws on a socket error
+    struct frame_return {
+        chameleon_packet_ring &free_frames;
+        chameleon_packet *cp;
+
+        ~frame_return() { free_frames.push(cp); }
+    } give_back{_free_send_frames, cp};
+    const size_t len = buff->packet_size();
+    if (len > 0) {
+        transport::send_udp_packet(_sock_fd, buff->data(), len);
+    }
+}
+
+uhd::transport::adapter_id_t chameleon_udp_link::get_send_adapter_id() const {
+    return uhd::transport::NULL_ADAPTER_ID;
+}
+
+transport::frame_buff::uptr chameleon_udp_link::get_frame(chameleon_packet *cp) {
+    return transport::frame_buff::uptr(&_frames[_pool->index_of(cp)]);
+}
+
+chameleon_packet *chameleon_udp_link::get_packet(const transport::frame_buff::uptr &buff) const {
+    if (!buff) {
+        return nullptr;
+    }
+    const auto *frame = static_cast<const link_frame_buff *>(buff.get());
+    return _pool->get(static_cast<size_t>(frame - _frames.data()));
+}
@@ -0,0 +1,87 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_UDP_LINK_HPP
+#define CHAMELEON_UDP_LINK_HPP
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "transport/link_if.hpp"
+#include "transport/udp_common.hpp"
+#include "chameleon_packet_pool.hpp"
+#include "chameleon_packet_ring.hpp"
+
+namespace ihd {
+
+/*!
+ * Connected UDP socket with a pre-allocated ring of send frames.
+ *
+ * The frames are carved out of a chameleon_packet_pool slab (cache line aligned, locked in memory)
+ * and tracked by a free ring. get_send_buff() hands out a free frame to be filled in place, so nothing
+ * is allocated or copied on the send path. The socket's send buffer is sized from
+ * link_params_t.send_buff_size, see calculate_udp_link_params().
+ *
+ * Send only, streams receive through chameleon_recv_link. Supports a single caller at a time.
+ */
+class chameleon_udp_link : public transport::send_link_if {
+public:
+    using sptr = std::shared_ptr<chameleon_udp_link>;
+
+    /*!
+     * Connect to addr:port
+     * \param params send frame count and size, the recv_* fields are ignored
+     * \throws uhd::io_error if the socket can't be opened or connected
+     */
+    static sptr make(const std::string &addr, const std::string &port, const transport::link_params_t &params);
+
+    ~chameleon_udp_link() override = default;
+
+    [[nodiscard]] size_t get_num_send_frames() const override { return _params.num_send_frames; }
+
+    [[nodiscard]] size_t get_send_frame_size() const override { return _params.send_frame_size; }
+
+    transport::frame_buff::uptr get_send_buff(int32_t timeout_ms) override;
+
+    void release_send_buff(transport::frame_buff::uptr buff) override;
+
+    [[nodiscard]] uhd::transport::adapter_id_t get_send_adapter_id() const override;
+
+    /*! Socket send buffer size the kernel granted */
+    [[nodiscard]] size_t get_send_buff_size() const { return _send_buff_size; }
+
+private:
+    /* frame_buff over one slot of the slab */
+    class link_frame_buff : public transport::frame_buff {
+    public:
+        explicit link_frame_buff(void *data) { _data = data; }
+    };
+
+    chameleon_udp_link(const std::string &addr, const std::string &port, const transport::link_params_t &params);
+
+    template<typename T, typename... Args>
+    friend std::unique_ptr<T, aligned_delete<T>> make_aligned(Args &&... args);
+
+    /*! Frame of pool packet cp */
+    transport::frame_buff::uptr get_frame(chameleon_packet *cp);
+
+    /*! Pool packet of a frame handed out by this link */
+    chameleon_packet *get_packet(const transport::frame_buff::uptr &buff) const;
+
+    transport::link_params_t _params;
+    boost::asio::io_service _io_service;
+    transport::socket_sptr _socket;
+    int _sock_fd;
+    size_t _send_buff_size{};
+
+    std::unique_ptr<chameleon_packet_pool> _pool;
+    std::vector<link_frame_buff> _frames; /* _frames[i] is the buffer of _pool packet i */
+    chameleon_packet_ring _free_send_frames;
+};
+
+} // ihd
+
+#endif //CHAMELEON_UDP_LINK_HPP
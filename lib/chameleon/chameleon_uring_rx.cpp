@@ -0,0 +1,378 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <linux/sock_diag.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "chameleon_uring_rx.hpp"
+#include "chameleon_packet.hpp"
+#include "debug.hpp"
+
+using namespace ihd;
+
+#if defined(IORING_RECV_MULTISHOT) && defined(__NR_io_uring_setup)
+#define CHAMELEON_HAVE_URING_MULTISHOT 1
+#endif
+
+#ifdef CHAMELEON_HAVE_URING_MULTISHOT
+static inline int io_uring_setup(uint32_t entries, io_uring_params *p) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static inline int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags,
+                                 const void *arg, size_t argsz) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz));
+}
+
+static inline int io_uring_register(int fd, uint32_t opcode, const void *arg, uint32_t nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+static inline void *ring_ptr(void *ring, uint32_t offset) {
+    return static_cast<uint8_t *>(ring) + offset;
+}
+
+static_assert(sizeof(io_uring_recvmsg_out) + sizeof(sockaddr_in) == chameleon_uring_rx::HEADROOM,
+              "recvmsg header does not fit the headroom");
+#endif
+
+chameleon_uring_rx::chameleon_uring_rx(int socket_fd, size_t max_batch, const timeval &timeout) :
+    _socket_fd(socket_fd),
+    _timeout_ns(static_cast<int64_t>(timeout.tv_sec) * 1000000000 + static_cast<int64_t>(timeout.tv_usec) * 1000) {
+    size_t entries = 1;
+    while (entries < max_batch) {
+        entries <<= 1;
+    }
+    _buf_packets.assign(entries, nullptr);
+    _buf_mask = static_cast<uint16_t>(entries - 1);
+    _recv_msg.msg_namelen = sizeof(sockaddr_in);
+}
+
+chameleon_uring_rx::~chameleon_uring_rx() {
+#ifdef CHAMELEON_HAVE_URING_MULTISHOT
+    if (_ring_fd > -1) {
+        // The kernel may write to provided packets until the multishot recv has really ended
+        cancel_recv();
+        if (_buf_ring != nullptr) {
+            io_uring_buf_reg reg{};
+            reg.bgid = BUFFER_GROUP;
+            io_uring_register(_ring_fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+        }
+        close(_ring_fd);
+    }
+    if (_buf_ring != nullptr) {
+        munmap(_buf_ring, _buf_ring_size);
+    }
+    if (_sqes != nullptr) {
+        munmap(_sqes, _sqes_size);
+    }
+    if (_cq_ring != nullptr && _cq_ring != _sq_ring) {
+        munmap(_cq_ring, _cq_ring_size);
+    }
+    if (_sq_ring != nullptr) {
+        munmap(_sq_ring, _sq_ring_size);
+    }
+#endif
+    close(_socket_fd);
+}
+
+bool chameleon_uring_rx::open() {
+#ifdef CHAMELEON_HAVE_URING_MULTISHOT
+    io_uring_params params{};
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    // One recv (plus its cancel) in flight, completions for a full batch of packets
+    params.flags |= IORING_SETUP_CQSIZE;
+    params.cq_entries = static_cast<uint32_t>(_buf_packets.size()) * 2;
+    _ring_fd = io_uring_setup(4, &params);
+    if (_ring_fd < 0 && errno == EINVAL) {
+        params = {};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = static_cast<uint32_t>(_buf_packets.size()) * 2;
+        _ring_fd = io_uring_setup(4, &params);
+    }
+    if (_ring_fd < 0) {
+        perror("io_uring_setup failed");
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        dbfprintf(stderr, "io_uring has no IORING_FEAT_EXT_ARG\n");
+        return false;
+    }
+
+    _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        _sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+    }
+    void *ring = mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      _ring_fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        perror("io_uring sq ring mmap failed");
+        return false;
+    }
+    _sq_ring = ring;
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        _cq_ring = _sq_ring;
+    } else {
+        ring = mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    _ring_fd, IORING_OFF_CQ_RING);
+        if (ring == MAP_FAILED) {
+            perror("io_uring cq ring mmap failed");
+            return false;
+        }
+        _cq_ring = ring;
+    }
+    _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    ring = mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+    if (ring == MAP_FAILED) {
+        perror("io_uring sqe mmap failed");
+        return false;
+    }
+    _sqes = static_cast<io_uring_sqe *>(ring);
+
+    _sq_head = static_cast<uint32_t *>(ring_ptr(_sq_ring, params.sq_off.head));
+    _sq_tail = static_cast<uint32_t *>(ring_ptr(_sq_ring, params.sq_off.tail));
+    _sq_mask = *static_cast<uint32_t *>(ring_ptr(_sq_ring, params.sq_off.ring_mask));
+    _sq_array = static_cast<uint32_t *>(ring_ptr(_sq_ring, params.sq_off.array));
+    _cq_head = static_cast<uint32_t *>(ring_ptr(_cq_ring, params.cq_off.head));
+    _cq_tail = static_cast<uint32_t *>(ring_ptr(_cq_ring, params.cq_off.tail));
+    _cq_mask = *static_cast<uint32_t *>(ring_ptr(_cq_ring, params.cq_off.ring_mask));
+    _cqes = static_cast<io_uring_cqe *>(ring_ptr(_cq_ring, params.cq_off.cqes));
+
+    _buf_ring_size = _buf_packets.size() * sizeof(io_uring_buf);
+    ring = mmap(nullptr, _buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED) {
+        perror("io_uring buffer ring mmap failed");
+        return false;
+    }
+    _buf_ring = static_cast<io_uring_buf_ring *>(ring);
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(_buf_ring);
+    reg.ring_entries = static_cast<uint32_t>(_buf_packets.size());
+    reg.bgid = BUFFER_GROUP;
+    if (io_uring_register(_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        perror("IORING_REGISTER_PBUF_RING failed");
+        munmap(_buf_ring, _buf_ring_size);
+        _buf_ring = nullptr;
+        return false;
+    }
+    dbprintf("io_uring: %zu provided buffers, sq:%u cq:%u\n", _buf_packets.size(), params.sq_entries,
+             params.cq_entries);
+    return true;
+#else
+    dbfprintf(stderr, "Built without io_uring multishot recvmsg support\n");
+    return false;
+#endif
+}
+
+#ifdef CHAMELEON_HAVE_URING_MULTISHOT
+void chameleon_uring_rx::provide(chameleon_packet *cp) {
+    const uint16_t bid = _buf_tail & _buf_mask;
+    // Not _buf_ring->bufs: in C++ __DECLARE_FLEX_ARRAY puts it 8 bytes past the start of the ring
+    io_uring_buf &buf = reinterpret_cast<io_uring_buf *>(_buf_ring)[bid];
+    buf.addr = reinterpret_cast<uint64_t>(cp->getPacketMem() - HEADROOM);
+    buf.len = static_cast<uint32_t>(cp->getBufferSize() + HEADROOM);
+    buf.bid = bid;
+    _buf_packets[bid] = cp;
+    _buf_tail++;
+}
+
+io_uring_sqe *chameleon_uring_rx::get_sqe() {
+    // This thread is the only submitter
+    const uint32_t tail = *_sq_tail;
+    if (tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) > _sq_mask) {
+        return nullptr; // Full
+    }
+    const uint32_t index = tail & _sq_mask;
+    io_uring_sqe *sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    _sq_array[index] = index;
+    return sqe;
+}
+
+void chameleon_uring_rx::arm_recv() {
+    io_uring_sqe *sqe = get_sqe();
+    if (sqe != nullptr) {
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = _socket_fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&_recv_msg);
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->user_data = RECV_TAG;
+        __atomic_store_n(_sq_tail, *_sq_tail + 1, __ATOMIC_RELEASE);
+        _to_submit++;
+        _armed = true;
+    }
+}
+
+int chameleon_uring_rx::enter(uint32_t min_complete, bool wait) {
+    __kernel_timespec ts{};
+    ts.tv_sec = _timeout_ns / 1000000000;
+    ts.tv_nsec = _timeout_ns % 1000000000;
+    io_uring_getevents_arg arg{};
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+    uint32_t flags = IORING_ENTER_EXT_ARG;
+    if (wait) {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+    int err = io_uring_enter(_ring_fd, _to_submit, min_complete, flags, &arg, sizeof(arg));
+    if (err >= 0) {
+        _to_submit -= std::min(_to_submit, static_cast<uint32_t>(err));
+    }
+    return err;
+}
+
+void chameleon_uring_rx::cancel_recv() {
+    if (_armed) {
+        io_uring_sqe *sqe = get_sqe();
+        if (sqe != nullptr) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = RECV_TAG;
+            sqe->user_data = CANCEL_TAG;
+            __atomic_store_n(_sq_tail, *_sq_tail + 1, __ATOMIC_RELEASE);
+            _to_submit++;
+        }
+    }
+    // Drain until the recv posts its final completion, each wait is bounded by the receive timeout
+    while (_armed) {
+        uint32_t head = *_cq_head;
+        if (head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+            if (enter(1, true) < 0 && errno != EINTR) {
+                break;
+            }
+            continue;
+        }
+        const io_uring_cqe &cqe = _cqes[head & _cq_mask];
+        if (cqe.user_data == RECV_TAG && !(cqe.flags & IORING_CQE_F_MORE)) {
+            _armed = false;
+        }
+        __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+    }
+}
+#endif
+
+int chameleon_uring_rx::receive(chameleon_packet **packets, size_t n) {
+#ifdef CHAMELEON_HAVE_URING_MULTISHOT
+    n = std::min(n, _buf_packets.size());
+    // packets[0.._provided) are still in the buffer ring from earlier calls, hand over the rest
+    for (size_t i = _provided; i < n; i++) {
+        provide(packets[i]);
+    }
+    _provided = std::max(_provided, n);
+    __atomic_store_n(&_buf_ring->tail, _buf_tail, __ATOMIC_RELEASE);
+
+    if (!_armed) {
+        arm_recv();
+    }
+
+    size_t filled = 0;
+    int err = 0;
+    bool waited = false;
+    while (filled < n && !err) {
+        uint32_t head = *_cq_head;
+        const uint32_t tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            if (filled > 0 || waited) {
+                break; // Return what we have, or time out
+            }
+            // Submit the recv if it needs it and block for the first completion
+            if (!_armed) {
+                arm_recv();
+            }
+            if (_timeout_ns == 0 && _to_submit == 0) {
+                break; // Spinning, only peek at the completion queue
+            }
+            if (enter(1, true) < 0) {
+                if (errno != ETIME && errno != EINTR) {
+                    err = -1;
+                }
+            }
+            waited = true;
+            continue;
+        }
+        for (; head != tail; head++) {
+            const io_uring_cqe &cqe = _cqes[head & _cq_mask];
+            if (cqe.user_data != RECV_TAG) {
+                continue;
+            }
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                _armed = false; // Re-armed on the next call, e.g. after -ENOBUFS
+            }
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                chameleon_packet *cp = _buf_packets[cqe.flags >> IORING_CQE_BUFFER_SHIFT];
+                // [io_uring_recvmsg_out][sender][payload], the payload lands at the packet buffer
+                const auto *out = reinterpret_cast<const io_uring_recvmsg_out *>(cp->getPacketMem() - HEADROOM);
+                if (cqe.res < static_cast<int>(HEADROOM) || (out->flags & MSG_TRUNC) ||
+                    out->payloadlen < ipsolon_rx_stream::PACKET_HEADER_SIZE) {
+                    // Truncated, or no room for the CHDR header and timestamp: give the buffer straight back
+                    provide(cp);
+                    __atomic_store_n(&_buf_ring->tail, _buf_tail, __ATOMIC_RELEASE);
+                    continue;
+                }
+                // Buffers are consumed in the order they were provided, keep the batch in that order too
+                chameleon_packet **pos = std::find(packets + filled, packets + _provided, cp);
+                if (pos != packets + _provided) {
+                    std::swap(*pos, packets[filled]);
+                }
+                cp->setPacketSize(out->payloadlen);
+                sockaddr_in sender{};
+                if (out->namelen >= sizeof(sender)) {
+                    memcpy(&sender, out + 1, sizeof(sender));
+                }
+                cp->setSource(sender.sin_addr.s_addr);
+                filled++;
+            } else if (cqe.res < 0 && cqe.res != -ENOBUFS) {
+                errno = -cqe.res;
+                err = -1;
+            }
+        }
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+    }
+    _provided -= filled;
+    if (filled == 0 && err) {
+        return -1;
+    }
+    return static_cast<int>(filled);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+void chameleon_uring_rx::reuse(chameleon_packet **packets, size_t n) {
+#ifdef CHAMELEON_HAVE_URING_MULTISHOT
+    // packets[n..n+_provided) are still in the buffer ring, so with these the front of the batch is again
+    for (size_t i = 0; i < n; i++) {
+        provide(packets[i]);
+    }
+    _provided += n;
+    __atomic_store_n(&_buf_ring->tail, _buf_tail, __ATOMIC_RELEASE);
+#endif
+}
+
+uint64_t chameleon_uring_rx::get_drops() {
+#ifdef SO_MEMINFO
+    uint32_t meminfo[SK_MEMINFO_VARS] = {};
+    socklen_t len = sizeof(meminfo);
+    if (getsockopt(_socket_fd, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0 && len > SK_MEMINFO_DROPS * sizeof(uint32_t)) {
+        _drops = meminfo[SK_MEMINFO_DROPS];
+    }
+#endif
+    return _drops;
+}
@@ -0,0 +1,117 @@
+/*
+* Copyright 2024 Ipsolon Research
+*
+* SPDX-License-Identifier: GPL-3.0-or-later
+*/
+
+#ifndef CHAMELEON_URING_RX_HPP
+#define CHAMELEON_URING_RX_HPP
+#include <cstdint>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "chameleon_rx_backend.hpp"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace ihd {
+    /*!
+     * io_uring backend: one multishot recvmsg on the VITA socket, with buffers picked from a provided buffer ring.
+     *
+     * The packets handed to receive() are added to the buffer ring, so the kernel writes each datagram
+     * straight into a pool packet and a whole batch of completions is reaped with a single io_uring_enter().
+     * The kernel takes buffers in the order they were provided, which is the order of the receive thread's batch.
+     * recvmsg puts its header and the sender's address in front of the payload, in the HEADROOM bytes the
+     * packet pool must keep free before every buffer.
+     *
+     * Raw syscalls on <linux/io_uring.h>, no liburing. Needs Linux 6.0 (multishot recvmsg, buffer rings),
+     * open() fails on older kernels or when io_uring is disabled so the caller can use chameleon_socket_rx.
+     */
+    class chameleon_uring_rx : public chameleon_rx_backend {
+    public:
+        /* io_uring_recvmsg_out and a sockaddr_in, asserted in the .cpp */
+        static constexpr size_t HEADROOM = 16 + sizeof(sockaddr_in);
+
+        /*!
+         * \param socket_fd bound UDP socket, closed by the destructor. The packets received into need HEADROOM.
+         * \param max_batch largest n passed to receive()
+         * \param timeout how long receive() waits for the first datagram, zero to spin on the completion queue
+         */
+        chameleon_uring_rx(int socket_fd, size_t max_batch, const timeval &timeout);
+
+        ~chameleon_uring_rx() override;
+
+        chameleon_uring_rx(const chameleon_uring_rx &) = delete;
+        chameleon_uring_rx &operator=(const chameleon_uring_rx &) = delete;
+
+        /*!
+         * Create the ring and register the buffer ring
+         * \return false when io_uring (or a feature this needs) is unavailable
+         */
+        bool open();
+
+        int receive(chameleon_packet **packets, size_t n) override;
+
+        /*! Provide the packets again, the batch is then in the buffer ring from its front up */
+        void reuse(chameleon_packet **packets, size_t n) override;
+
+        /*! The socket's drop counter (SO_MEMINFO), the recvmsg buffers leave no room for SO_RXQ_OVFL */
+        uint64_t get_drops() override;
+
+    private:
+        static constexpr uint16_t BUFFER_GROUP = 0;
+        static constexpr uint64_t RECV_TAG = 1;
+        static constexpr uint64_t CANCEL_TAG = 2;
+
+        int _socket_fd;
+        int64_t _timeout_ns;
+        int _ring_fd{-1};
+
+        /* Submission queue */
+        void *_sq_ring{};
+        size_t _sq_ring_size{};
+        uint32_t *_sq_head{};
+        uint32_t *_sq_tail{};
+        uint32_t _sq_mask{};
+        uint32_t *_sq_array{};
+        io_uring_sqe *_sqes{};
+        size_t _sqes_size{};
+        uint32_t _to_submit{};
+
+        /* Completion queue, may share the submission queue mapping */
+        void *_cq_ring{};
+        size_t _cq_ring_size{};
+        uint32_t *_cq_head{};
+        uint32_t *_cq_tail{};
+        uint32_t _cq_mask{};
+        io_uring_cqe *_cqes{};
+
+        /* Provided buffer ring, buffer id i is slot i */
+        io_uring_buf_ring *_buf_ring{};
+        size_t _buf_ring_size{};
+        uint16_t _buf_mask{};
+        uint16_t _buf_tail{};
+        std::vector<chameleon_packet *> _buf_packets;
+        size_t _provided{}; /* Packets at the front of the batch already in the buffer ring */
+
+        msghdr _recv_msg{}; /* Tells the multishot recvmsg the name and control sizes of every buffer */
+        bool _armed{}; /* The multishot recv is still posting completions */
+        uint64_t _drops{};
+
+        void provide(chameleon_packet *cp);
+
+        io_uring_sqe *get_sqe();
+
+        void arm_recv();
+
+        int enter(uint32_t min_complete, bool wait);
+
+        void cancel_recv();
+    };
+} // ihd
+
+#endif //CHAMELEON_URING_RX_HPP
@@ -20,6 +20,30 @@ const std::string ipsolon_rx_stream::stream_type::STREAM_DEST_PORT_KEY = "PORT";
 const std::string ipsolon_rx_stream::stream_type::FFT_AVG_COUNT_KEY = "FFT_AVERAGE_COUNT";
 const std::string ipsolon_rx_stream::stream_type::FFT_SIZE_KEY = "FFT_SIZE";
 
+const std::string ipsolon_rx_stream::stream_type::RECV_BATCH_KEY = "RECV_BATCH";
+const std::string ipsolon_rx_stream::stream_type::HUGE_PAGES_KEY = "HUGE_PAGES";
+const std::string ipsolon_rx_stream::stream_type::RECV_BACKEND_KEY = "RECV_BACKEND";
+const std::string ipsolon_rx_stream::stream_type::SOCKET_BACKEND = "socket";
+const std::string ipsolon_rx_stream::stream_type::AF_PACKET_BACKEND = "af_packet";
+const std::string ipsolon_rx_stream::stream_type::URING_BACKEND = "io_uring";
+const std::string ipsolon_rx_stream::stream_type::RECV_CPU_KEY = "RECV_CPU";
+const std::string ipsolon_rx_stream::stream_type::RECV_PRIORITY_KEY = "RECV_PRIORITY";
+const std::string ipsolon_rx_stream::stream_type::BUSY_POLL_KEY = "BUSY_POLL";
+const std::string ipsolon_rx_stream::stream_type::RECV_SPIN_KEY = "RECV_SPIN";
+const std::string ipsolon_rx_stream::stream_type::RECV_THREADS_KEY = "RECV_THREADS";
+const std::string ipsolon_rx_stream::stream_type::RECV_STEERING_KEY = "RECV_STEERING";
+const std::string ipsolon_rx_stream::stream_type::SEQ_STEERING = "seq";
+const std::string ipsolon_rx_stream::stream_type::HASH_STEERING = "hash";
+const std::string ipsolon_rx_stream::stream_type::OVERFLOW_POLICY_KEY = "OVERFLOW_POLICY";
+const std::string ipsolon_rx_stream::stream_type::BLOCK_OVERFLOW = "block";
+const std::string ipsolon_rx_stream::stream_type::DROP_NEWEST_OVERFLOW = "drop_newest";
+const std::string ipsolon_rx_stream::stream_type::DROP_OLDEST_OVERFLOW = "drop_oldest";
+const std::string ipsolon_rx_stream::stream_type::SAMPLE_RATE_KEY = "SAMPLE_RATE";
+const std::string ipsolon_rx_stream::stream_type::BUFFER_TIME_KEY = "BUFFER_TIME";
+const std::string ipsolon_rx_stream::stream_type::BUFFER_BYTES_KEY = "BUFFER_BYTES";
+const std::string ipsolon_rx_stream::stream_type::NUMA_NODE_KEY = "NUMA_NODE";
+const std::string ipsolon_rx_stream::stream_type::REACTOR_THREADS_KEY = "REACTOR_THREADS";
+
 ipsolon_rx_stream::sptr ipsolon_rx_stream::make(const uhd::stream_args_t &stream_cmd,
                                                 const uhd::device_addr_t &device_addr) {
     // There is only one option right now
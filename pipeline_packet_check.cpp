@@ -25,7 +25,7 @@ namespace po = boost::program_options;
 class RxStream {
 public:
     RxStream(size_t chan, const ihd::ipsolon_isrp::sptr &isrp, uint32_t tt,
-             uhd::stream_args_t &stream_args) : channel(chan), total_time(tt) {
+             uhd::stream_args_t &stream_args, uint32_t delay_us) : channel(chan), total_time(tt), recv_delay_us(delay_us) {
         std::vector<size_t> channel_nums;
         channel_nums.push_back(chan);
         stream_args.channels = channel_nums;
@@ -52,22 +52,54 @@ public:
         err = run_loop();
         stream_cmd.stream_mode = uhd::stream_cmd_t::STREAM_MODE_STOP_CONTINUOUS;
         rx_stream->issue_stream_cmd(stream_cmd);
+        print_recv_stats();
         return (err);
     }
 
+    void print_recv_stats() const {
+        auto isrp_stream = std::dynamic_pointer_cast<ihd::ipsolon_rx_stream>(rx_stream);
+        if (isrp_stream) {
+            ihd::ipsolon_rx_stream::stream_stats_t stats = isrp_stream->get_stats();
+            double per_call = stats.recv_calls ? (double) stats.packets / (double) stats.recv_calls : 0.0;
+            printf("RECV chan:%zu packets:%lu recv calls:%lu packets/syscall:%f\n",
+                   channel, stats.packets, stats.recv_calls, per_call);
+            printf("RECV chan:%zu bytes:%lu dropped:%lu reordered:%lu starved:%lu queue high water:%lu "
+                   "socket drops:%lu overflow drops:%lu\n", channel, stats.bytes, stats.dropped_packets,
+                   stats.reorder_events, stats.free_starvation, stats.queue_high_water, stats.socket_drops,
+                   stats.overflow_drops);
+            printf("RECV chan:%zu pool packets:%lu pool bytes:%lu socket buffer:%lu\n", channel,
+                   stats.pool_packets, stats.pool_bytes, stats.socket_buffer);
+        }
+    }
+
 private:
     uhd::stream_args_t stream_args{};
 
 protected:
     size_t channel{};
     uint32_t total_time{};
+    uint32_t recv_delay_us{}; /* A slow consumer, the receive thread starves and sequence gaps are expected */
     uhd::rx_streamer::sptr rx_stream{};
+
+    /* Count an out of sequence packet as an error unless a slow consumer makes gaps expected */
+    void check_sequence(const uhd::rx_metadata_t &md, uint64_t &errors, uint64_t &gaps) const {
+        if (!md.out_of_sequence) {
+            return;
+        }
+        if (recv_delay_us) {
+            gaps++;
+        } else {
+            fprintf(stderr, "*** OUT OF SEQUENCE PACKET:\n%s\n***\n", md.to_pp_string(false).c_str());
+            errors++;
+        }
+    }
 };
 
 class RxStreamPsd : public RxStream {
 public:
-    RxStreamPsd(size_t chan, const ihd::ipsolon_isrp::sptr &isrp, uint32_t tt, uhd::stream_args_t &stream_args)
-        : RxStream(chan, isrp, tt, stream_args) {
+    RxStreamPsd(size_t chan, const ihd::ipsolon_isrp::sptr &isrp, uint32_t tt, uhd::stream_args_t &stream_args,
+                uint32_t delay_us)
+        : RxStream(chan, isrp, tt, stream_args, delay_us) {
     }
 
     virtual ~RxStreamPsd() = default;
@@ -88,12 +120,10 @@ private:
         uint64_t errors = 0;
         uint64_t packets = 0;
         uint64_t bytes = 0;
+        uint64_t gaps = 0;
         while (std::chrono::high_resolution_clock::now() - startTime < duration) {
             size_t n = rx_stream->recv(buffs, spb, md, 5);
-            if (md.out_of_sequence) {
-                fprintf(stderr, "*** OUT OF SEQUENCE PACKET:\n%s\n***\n", md.to_pp_string(false).c_str());
-                errors++;
-            }
+            check_sequence(md, errors, gaps);
             if (!n) {
                 fprintf(stderr, "*** No bytes received:\n%s\n***\n", md.to_pp_string(false).c_str());
                 errors++;
@@ -101,22 +131,26 @@ private:
                 packets++;
             }
             bytes += n;
+            if (recv_delay_us) {
+                std::this_thread::sleep_for(std::chrono::microseconds(recv_delay_us));
+            }
         }
         auto finishTime = std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::high_resolution_clock::now() - startTime);
         bytes *= 4; /* bytes = samples * 4 */
         bytes += 16 * packets; /* Account for CHDR */
         double megabits_per_second = (((double) bytes / total_time) / (1024 * 1024)) * 8;
-        printf("RESULT chan:%zu duration ms:%ld packets:%lu bytes:%lu Mb/s:%f errors:%lu\n",
-               channel, finishTime.count(), packets, bytes, megabits_per_second, errors);
+        printf("RESULT chan:%zu duration ms:%ld packets:%lu bytes:%lu Mb/s:%f errors:%lu gaps:%lu\n",
+               channel, finishTime.count(), packets, bytes, megabits_per_second, errors, gaps);
         return (errors == 0) ? 0 : -1;
     }
 };
 
 class RxStreamIq : public RxStream {
 public:
-    RxStreamIq(size_t chan, const ihd::ipsolon_isrp::sptr &isrp, uint32_t tt, uhd::stream_args_t &stream_args)
-        : RxStream(chan, isrp, tt, stream_args) {
+    RxStreamIq(size_t chan, const ihd::ipsolon_isrp::sptr &isrp, uint32_t tt, uhd::stream_args_t &stream_args,
+               uint32_t delay_us)
+        : RxStream(chan, isrp, tt, stream_args, delay_us) {
     }
 
     virtual ~RxStreamIq() = default;
@@ -137,13 +171,11 @@ private:
         uint64_t errors = 0;
         uint64_t packets = 0;
         uint64_t bytes = 0;
+        uint64_t gaps = 0;
         // FIXME - TEMP_PACKET_LIMIT is temporary until udp keeps up with dma
         while ((std::chrono::high_resolution_clock::now() - startTime < duration) && (packets < TEMP_PACKET_LIMIT)) {
             size_t n = rx_stream->recv(buffs, spb, md, 5);
-            if (md.out_of_sequence) {
-                fprintf(stderr, "*** OUT OF SEQUENCE PACKET:\n%s\n***\n", md.to_pp_string(false).c_str());
-                errors++;
-            }
+            check_sequence(md, errors, gaps);
             if (!n) {
                 fprintf(stderr, "*** No bytes received:\n%s\n***\n", md.to_pp_string(false).c_str());
                 errors++;
@@ -151,14 +183,17 @@ private:
                 packets++;
             }
             bytes += n;
+            if (recv_delay_us) {
+                std::this_thread::sleep_for(std::chrono::microseconds(recv_delay_us));
+            }
         }
         auto finishTime = std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::high_resolution_clock::now() - startTime);
         bytes *= 4; /* bytes = samples * 4 */
         bytes += 16 * packets; /* Account for CHDR */
         double megabits_per_second = (((double) bytes / total_time) / (1024 * 1024)) * 8;
-        printf("RESULT chan:%zu duration ms:%ld packets:%lu bytes:%lu Mb/s:%f errors:%lu\n",
-               channel, finishTime.count(), packets, bytes, megabits_per_second, errors);
+        printf("RESULT chan:%zu duration ms:%ld packets:%lu bytes:%lu Mb/s:%f errors:%lu gaps:%lu\n",
+               channel, finishTime.count(), packets, bytes, megabits_per_second, errors, gaps);
         return (errors == 0) ? 0 : -1;
     }
 };
@@ -174,6 +209,9 @@ int IHD_SAFE_MAIN(int argc, char *argv[]) {
     uint16_t dest_port;
     uint32_t fft_size;
     uint32_t fft_avg;
+    uint32_t recv_batch;
+    uint32_t recv_delay;
+    std::string recv_args;
     std::string stream_type;
 
     po::options_description desc("Allowed options");
@@ -186,6 +224,11 @@ int IHD_SAFE_MAIN(int argc, char *argv[]) {
             ("dest_port", po::value<uint16_t>(&dest_port)->default_value(9090), "destination port")
             ("fft_size", po::value<uint32_t>(&fft_size)->default_value(256), "FFT size (256, 512, 1024, 2048 or 4096")
             ("fft_avg", po::value<uint32_t>(&fft_avg)->default_value(105), "FFT averaging count")
+            ("recv_batch", po::value<uint32_t>(&recv_batch)->default_value(1), "max packets per receive syscall")
+            ("recv_args", po::value<std::string>(&recv_args)->default_value(""),
+             "extra receive thread stream args, e.g. RECV_CPU=2,RECV_PRIORITY=50,BUSY_POLL=50,RECV_SPIN=true")
+            ("recv_delay", po::value<uint32_t>(&recv_delay)->default_value(0),
+             "usec to sleep after each recv, a slow consumer that starves the receive thread (gaps are not errors)")
             ("args", po::value<std::string>(&args)->default_value(""), "ISRP device address args")
             ("stream_type", po::value<std::string>(&stream_type)->default_value("psd"), "Stream type - (psd or iq)");
     po::variables_map vm;
@@ -244,6 +287,11 @@ int IHD_SAFE_MAIN(int argc, char *argv[]) {
         fprintf(stderr, "Error: Invalid stream_type\n");
         exit(1);
     }
+    stream_args.args[ihd::ipsolon_rx_stream::stream_type::RECV_BATCH_KEY] = std::to_string(recv_batch);
+    const uhd::device_addr_t recv_stream_args(recv_args);
+    for (const std::string &key : recv_stream_args.keys()) {
+        stream_args.args[key] = recv_stream_args[key];
+    }
 
     std::vector<int> async_results;
     std::vector<RxStream *> stream_vector;
@@ -256,11 +304,11 @@ int IHD_SAFE_MAIN(int argc, char *argv[]) {
             std::thread *thread_obj;
             RxStream *rxStream;
             if (stream_type == ihd::ipsolon_rx_stream::stream_type::PSD_STREAM) {
-                rxStream = new RxStreamPsd(chan, isrp, total_time, stream_args);
+                rxStream = new RxStreamPsd(chan, isrp, total_time, stream_args, recv_delay);
                 auto future = std::async(&RxStream::stream_run, rxStream);
                 async_results.push_back(future.get());
             } else {
-                rxStream = new RxStreamIq(chan, isrp, total_time, stream_args);
+                rxStream = new RxStreamIq(chan, isrp, total_time, stream_args, recv_delay);
                 auto future = std::async(&RxStream::stream_run, rxStream);
                 async_results.push_back(future.get());
             }
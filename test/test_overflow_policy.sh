@@ -0,0 +1,50 @@
+#!/bin/bash
+
+if [[ $# -lt 3 ]]
+then
+  echo "Usage: $(basename $0) DEST_IP DEST_PORT CHAMELEON_IP RECV_DELAY_US[optional]"
+  exit 1
+fi
+dest_ip=$1
+dest_port=$2
+cham_ip=$3
+
+if [[ $# -ne 4 ]]
+then
+   recv_delay=2000
+else
+   recv_delay=$4
+fi
+
+echo "Running with dest_ip=$dest_ip cham_ip=$cham_ip recv_delay=$recv_delay"
+
+let "errors=0"
+
+# A consumer slower than the stream with a small packet pool starves the receive thread, so each
+# drop policy runs its starved path on every receive backend
+function exec_overflow_check() {
+   local backend=$1
+   local policy=$2
+
+   GREEN='\033[0;32m'
+   WHITE='\033[0;37m'
+   echo -e "${GREEN} Running test with backend ${backend} overflow policy ${policy} ${WHITE}\n"
+   output=$(./pipeline_packet_check --stream_type=psd --dest_ip="${dest_ip}" --dest_port="${dest_port}" \
+            --args=addr="${cham_ip}" --chan_mask=1 --duration=10 --recv_batch=8 --recv_delay="${recv_delay}" \
+            --recv_args=RECV_BACKEND="${backend}",OVERFLOW_POLICY="${policy}",BUFFER_BYTES=65536)
+   ret_code=$?
+   echo "${output}"
+   if [ $ret_code != 0 ]; then  let "errors=errors+1";  echo -e "***ERROR: backend: ${backend} policy: ${policy}\n"; fi
+   if echo "${output}" | grep -q "overflow drops:0$"; then
+      let "errors=errors+1";  echo -e "***ERROR: backend: ${backend} policy: ${policy} never starved\n"
+   fi
+}
+
+for backend in socket af_packet io_uring
+do
+   exec_overflow_check "${backend}" drop_newest
+   exec_overflow_check "${backend}" drop_oldest
+done
+
+echo "ERRORS = ${errors}"
+exit $errors